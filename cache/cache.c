@@ -1,21 +1,28 @@
 #include "csim.h"
+#include "sweep.h"
+#include "shard.h"
+#include "nextuse.h"
+#include "mshr.h"
+#include "prefetch.h"
+#include "repl.h"
+#include "vcache.h"
+#include "heatmap.h"
 #include "trace.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <assert.h>
-
-typedef struct _pendingRequest {
-    int64_t tag;
-    int8_t procNum;
-    void (*memCallback)(int, int64_t);
-} pendingRequest;
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 csim *self = NULL; // csim is the cache object, see csim.h for definition
-line *vcache = NULL; // victim cache will be a 1D array of line structs
 int processorCount = 1;
+int CADSS_FUNCTIONAL = 0; // set by the engine while warming up, no timing is modeled
 bool verbose = false; // set this to true if you want print logs
 pendingRequest pending = {0};
 int countDown = 0;
@@ -24,6 +31,26 @@ int s = -1; // # of set bits, and S = 2^s gives number of sets
 int b = -1; // # of block bits, and B = 2^b gives number of block bytes
 int v = -1; // # of lines in victim cache
 int k = -1; // # of bits in the RRPV, max value of RRPV is 2^k - 1
+bool sweep = false; // -s and / or -E given as lo:hi ranges, see sweep.c
+int sHi = -1, EHi = -1; // upper ends of the ranges, the cache itself uses the lower ends
+int threads = 0; // -T n, simulate the sets on n threads, see shard.c
+int mshrs = 0; // -m n, non-blocking with n MSHRs, 0 keeps one pending request
+cache_stats stats = {0};
+prefetch_kind pfKind = PF_NONE; // -F nextline|stride|stream
+int pfDegree = 1; // -D n, lines per prefetch
+int heatTop = 0; // -H n, report the n lines and pages with the most misses
+unsigned long now = 0; // ticks simulated so far
+#define PREFETCH_LATENCY 100 // a prefetch takes as long as a cold miss
+
+struct {
+    unsigned long issued; // fills of lines that were not cached
+    unsigned long useful; // prefetched lines hit before being evicted
+    unsigned long late; // useful, but hit before the fill completed
+    unsigned long useless; // prefetched lines evicted without a hit
+} pf = {0};
+
+const repl_policy *policy = &replLRU; // -P, see repl.c
+FILE *nextUseFile = NULL; // -N, next-use annotations from cadss-nextuse
 
 void printv(const char *format, ...) { // wrapper for printf, only prints when verbose is set to true
     va_list args;
@@ -33,6 +60,9 @@ void printv(const char *format, ...) { // wrapper for printf, only prints when v
 
 void memoryRequest(trace_op* op, int processorNum, int64_t tag,
                    void (*callback)(int, int64_t));
+int cacheAccess(unsigned long addr, bool store, unsigned long pc, uint64_t nextUse, cache_stats *st);
+bool cacheProbe(unsigned long addr);
+int mshrAccess(const mshr_op *op);
 
 int pow2(int n) {
     if (n == 0)
@@ -41,21 +71,121 @@ int pow2(int n) {
         return 2 * pow2(n - 1);
 }
 
+
+// returns the first way that is not valid, or -1 if the set is full
+static int firstEmpty(const uint64_t *valid) {
+    for (int w = 0; w < self->words; w++) {
+        uint64_t empty = ~valid[w];
+        if (w == self->words - 1 && (E & 63)) empty &= (1UL << (E & 63)) - 1;
+        if (empty) return (w << 6) + __builtin_ctzl(empty);
+    }
+    return -1;
+}
+
+// Tag match: compare every way of the set against the tag, turn the result into a
+// bitmask, and keep the first hit among the valid ways.  The row is padded to a
+// multiple of 4 tags so the vector versions never need a remainder loop.
+static int findTagScalar(const unsigned long *tags, const uint64_t *valid, unsigned long tag) {
+    for (int j = 0; j < E; j++)
+        if (tags[j] == tag && getBit(valid, j)) return j;
+    return -1;
+}
+
+#if defined(__x86_64__)
+// SSE2 has no 64-bit compare, so both 32-bit halves have to match
+static int findTagSSE2(const unsigned long *tags, const uint64_t *valid, unsigned long tag) {
+    __m128i key = _mm_set1_epi64x(tag);
+    for (int w = 0; w < self->words; w++) {
+        uint64_t hits = 0;
+        int end = (w + 1) * 64 < self->ways ? (w + 1) * 64 : self->ways;
+        for (int j = w * 64; j < end; j += 2) {
+            __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)&tags[j]), key);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xb1));
+            hits |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << (j & 63);
+        }
+        hits &= valid[w];
+        if (hits) return (w << 6) + __builtin_ctzl(hits);
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static int findTagAVX2(const unsigned long *tags, const uint64_t *valid, unsigned long tag) {
+    __m256i key = _mm256_set1_epi64x(tag);
+    for (int w = 0; w < self->words; w++) {
+        uint64_t hits = 0;
+        int end = (w + 1) * 64 < self->ways ? (w + 1) * 64 : self->ways;
+        for (int j = w * 64; j < end; j += 4) {
+            __m256i eq = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)&tags[j]), key);
+            hits |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << (j & 63);
+        }
+        hits &= valid[w];
+        if (hits) return (w << 6) + __builtin_ctzl(hits);
+    }
+    return -1;
+}
+#endif
+
+// parses either "n" or "lo:hi", returns whether it was a range
+static bool parseRange(const char *arg, int *lo, int *hi) {
+    char *colon = strchr(arg, ':');
+    *lo = atoi(arg);
+    *hi = colon ? atoi(colon + 1) : *lo;
+    return colon != NULL;
+}
+
+// opens a cadss-nextuse annotation file and checks its header
+static FILE *openNextUse(const char *name) {
+    nextuse_header header;
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        perror("Attempt to open next-use annotations");
+        return NULL;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, NEXTUSE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s is not a next-use annotation file\n", name);
+        fclose(f);
+        return NULL;
+    }
+    if ((int)header.blockBits != b) {
+        fprintf(stderr, "%s was annotated with -b %u, the cache uses -b %d\n", name, header.blockBits, b);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// annotations are in the order of the trace's memory ops, which is the order
+// the requests arrive in for a single core
+static uint64_t readNextUse(void) {
+    uint64_t next;
+    if (fread(&next, sizeof(next), 1, nextUseFile) == 1) return next;
+    fprintf(stderr, "Ran out of next-use annotations, treating the rest as never reused\n");
+    fclose(nextUseFile);
+    nextUseFile = NULL;
+    return NEXTUSE_NEVER;
+}
+
+int (*findTag)(const unsigned long *, const uint64_t *, unsigned long) = findTagScalar;
+
+static inline uint64_t *replState(int set) { return &self->repl[set * self->replWords]; }
+
 csim* init(cache_sim_args* csa)
 {
     extern char *optarg;
     int op;
+    char *nextUseName = NULL;
 
     // process arguments to fill in the parameters of the cache
-    while ((op = getopt(csa->arg_count, csa->arg_list, "E:s:b:i:R:")) != -1)
+    while ((op = getopt(csa->arg_count, csa->arg_list, "E:s:b:i:R:P:T:N:m:F:D:H:")) != -1)
     {
         switch (op)
         {
             case 'E':
-                E = atoi(optarg);
+                sweep |= parseRange(optarg, &E, &EHi);
                 break;
             case 's':
-                s = atoi(optarg);
+                sweep |= parseRange(optarg, &s, &sHi);
                 break;
             case 'b':
                 b = atoi(optarg);
@@ -66,9 +196,72 @@ csim* init(cache_sim_args* csa)
             case 'R':
                 k = atoi(optarg);
                 break;
+            case 'T':
+                threads = atoi(optarg);
+                break;
+            case 'F':
+                pfKind = prefetchKind(optarg);
+                break;
+            case 'D':
+                pfDegree = atoi(optarg);
+                break;
+            case 'H':
+                heatTop = atoi(optarg);
+                break;
+            case 'm':
+                mshrs = atoi(optarg);
+                break;
+            case 'N':
+                nextUseName = optarg;
+                break;
+            case 'P':
+                if (replPolicy(optarg)) policy = replPolicy(optarg);
+                else fprintf(stderr, "Unknown replacement policy %s, using LRU\n", optarg);
+                break;
         }
     } printv("Input parameters: E = %d, s = %d, b = %d, v = %d, k = %d\n", E, s, b, v, k);
 
+    if (nextUseName) nextUseFile = openNextUse(nextUseName);
+    if (k != -1 && !policy->shared) { // RRIP takes precedence, as it always has, SHiP and Hawkeye use k
+        policy = &replRRIP;
+    } else if (k != -1 && (k < 1 || k > 8)) { // their RRPV is a byte of the way word
+        fprintf(stderr, "%s needs -R between 1 and 8, using its default\n", policy->name);
+        k = -1;
+    } else if (policy == &replPLRU && (E & (E - 1)) != 0) {
+        fprintf(stderr, "Tree-PLRU needs a power of 2 associativity, using LRU\n");
+        policy = &replLRU;
+    } else if (policy == &replOPT && !nextUseFile) {
+        fprintf(stderr, "OPT needs next-use annotations (-N), using LRU\n");
+        policy = &replLRU;
+    }
+
+    if (threads > 0 && v > 0) {
+        fprintf(stderr, "The victim cache is shared by every set, not using threads\n");
+        threads = 0;
+    } else if (threads > 0 && policy == &replOPT) {
+        fprintf(stderr, "OPT reads its annotations in request order, not using threads\n");
+        threads = 0;
+    } else if (threads > 0 && policy->shared) {
+        fprintf(stderr, "%s learns from every set, not using threads\n", policy->name);
+        threads = 0;
+    } else if (threads > 0 && mshrs > 0) {
+        fprintf(stderr, "MSHRs need the latency of each access, not using threads\n");
+        threads = 0;
+    } else if (threads > 0 && pfKind != PF_NONE) {
+        fprintf(stderr, "Prefetchers train on every access in order, not using threads\n");
+        threads = 0;
+    } else if (threads > 0 && heatTop > 0) {
+        fprintf(stderr, "The heatmap counts every access in one place, not using threads\n");
+        threads = 0;
+    }
+
+    if (sweep) {
+        if (EHi < E || sHi < s || E < 1 || s < 0) {
+            fprintf(stderr, "Invalid sweep range -s %d:%d -E %d:%d, not sweeping\n", s, sHi, E, EHi);
+            sweep = false;
+        } else sweepInit(s, sHi, E, EHi, b, nextUseFile != NULL);
+    }
+
     // initialize the cache here
     self = malloc(sizeof(csim));
     self->memoryRequest = memoryRequest;
@@ -77,85 +270,100 @@ csim* init(cache_sim_args* csa)
     self->si.destroy = destroy;
     int S = pow2(s);
     int B = pow2(b);
-    line **cache = calloc(sizeof(line*), S);
-    cache = calloc(sizeof(line*), S);
-    for (int i = 0; i < S; i++) cache[i] = calloc(sizeof(line), E);
-    self->cache = cache;
+
+    // one allocation holds every set: tags, then valid bits, dirty bits and counters
+    self->ways = (E + 3) & ~3;
+    self->words = (E + 63) / 64;
+    size_t tagBytes = sizeof(unsigned long) * S * self->ways;
+    size_t bitBytes = sizeof(uint64_t) * S * self->words;
+    self->replWords = policy->init(S, E, k);
+    size_t replBytes = sizeof(uint64_t) * S * self->replWords;
+    size_t total = (tagBytes + 2 * bitBytes + replBytes + 31) & ~(size_t)31;
+    char *storage = aligned_alloc(32, total);
+    memset(storage, 0, total);
+    self->tags = (unsigned long *)storage;
+    self->vbits = (uint64_t *)(storage + tagBytes);
+    self->dbits = (uint64_t *)(storage + tagBytes + bitBytes);
+    self->repl = (uint64_t *)(storage + tagBytes + 2 * bitBytes);
+    for (int i = 0; policy->reset && i < S; i++) policy->reset(replState(i));
+
+#if defined(__x86_64__)
+    findTag = __builtin_cpu_supports("avx2") ? findTagAVX2 : findTagSSE2;
+#endif
     printv("Initialized cache of %d x %d x %d\n", S, E, B);
     if (v > 0) { // initialize the victim cache if applicable
-        vcache = calloc(sizeof(line), v); 
+        vcacheInit(v);
         printv("Initialized victim cache of size 1 x %d x %d\n", v, B);
     } printv("\n");
+    if (threads > 0) shardInit(threads, s, b, cacheAccess);
+    if (mshrs > 0) mshrInit(mshrs, b, mshrAccess, cacheProbe);
+    if (heatTop > 0) heatmapInit(heatTop);
+    self->pbits = NULL;
+    self->ready = NULL;
+    if (pfKind != PF_NONE) {
+        prefetchInit(pfKind, pfDegree);
+        self->pbits = calloc(S * self->words, sizeof(uint64_t));
+        self->ready = calloc((size_t)S * E, sizeof(unsigned long));
+    }
 
     return self;
 }
 
-void handleHit(int set, int index, bool store) {
-    line *l = &self->cache[set][index]; 
-    l->evict = 0; // set to 0 in both LRU and RRPV case
-    if (store && l->dbit == 0) l->dbit = 1;
+// The handlers return the latency of the access, 0 when they leave the current
+// countdown alone.  They only touch their own set (and the victim cache), which
+// is what lets the sharded mode run them from several threads.
+int handleHit(int set, int index, bool store, const repl_access *a) {
+    policy->onHit(replState(set), set, index, a);
+    if (store) setBit(&self->dbits[set * self->words], index);
     printv("Got cache hit in set %d at index %d\n", set, index);
+    return 0;
 }
 
-void handleColdMiss(unsigned long tag, int set, int index, bool store, line *vcacheHit) {
-    line *l = &self->cache[set][index];
-    l->tag = tag;
-    l->vbit = 1;
+int handleColdMiss(unsigned long tag, int set, int index, bool store, const line *vcacheHit, const repl_access *a) {
+    int latency = 0;
+    uint64_t *dirty = &self->dbits[set * self->words];
+    self->tags[set * self->ways + index] = tag;
+    setBit(&self->vbits[set * self->words], index);
+    policy->onFill(replState(set), set, index, a);
     if (vcacheHit) {
-        l->evict = 0;
-        l->dbit = vcacheHit->dbit;
-        free(vcacheHit);
+        if (vcacheHit->dirty) setBit(dirty, index);
+        else clearBit(dirty, index);
         printv("Got victim cache hit, loading into main cache set %d at index %d\n", set, index);
     } else {
-        if (k != -1) l->evict = pow2(k) - 1; // RRPV case  
-        else l->evict = 0; // LRU case
-        countDown = 100;
+        latency = 100;
         printv("Got cold cache miss, loaded into set %d at index %d\n", set, index);
-    } if (store) l->dbit = 1;
+    } if (store) setBit(dirty, index);
+    return latency;
 }
 
-void handleConflictMiss(unsigned long tag, int set, int index, bool store, line *vcacheHit) {
-    line *l = &self->cache[set][index];
+int handleConflictMiss(unsigned long tag, int set, int index, bool store, const line *vcacheHit, const repl_access *a) {
+    int latency = 0;
+    uint64_t *dirty = &self->dbits[set * self->words];
+    unsigned long *l = &self->tags[set * self->ways + index];
 
     // if victim cache exists, add to it first
-    if (vcache) {
-        int vEmptyIndex = -1; 
-        int vEvictVal = -1; 
-        int vEvictIndex = -1;
-        line *vl;
-        for (int i = 0; i < v; i++) {
-            vl = &vcache[i];
-            if (vl->vbit == 0 && vEmptyIndex == -1) vEmptyIndex = i;
-            else if (vl->vbit == 1 && ++vl->evict > vEvictVal) {
-                vEvictVal = vl->evict;
-                vEvictIndex = i;
-            }
-        } if (vEmptyIndex != -1) vl = &vcache[vEmptyIndex];
-        else {
-            vl = &vcache[vEvictIndex];
-            countDown = vl->dbit == 1 ? 150 : 100;
-            printv("Evicting from victim cache...\n");
-        } vl->vbit = 1;
-        vl->dbit = l->dbit;
-        vl->evict = 0;
-        vl->tag = l->tag;
+    bool evictedDirty;
+    if (v > 0 && vcacheInsert((*l << s) | set, getBit(dirty, index), &evictedDirty)) {
+        latency = evictedDirty ? 150 : 100;
+        printv("Evicting from victim cache...\n");
     }
-        
-    l->tag = tag;
+
+
+    *l = tag;
+    policy->onEvict(replState(set), set, index);
+    policy->onFill(replState(set), set, index, a);
     if (vcacheHit) {
-        l->evict = 0;
-        l->dbit = vcacheHit->dbit;
-        free(vcacheHit);
+        if (vcacheHit->dirty) setBit(dirty, index);
+        else clearBit(dirty, index);
         printv("Got victim cache hit, loading into main cache set %d at index %d\n", set, index);
     } else {
-        if (k != -1) l->evict = pow2(k) - 1; // RRPV case  
-        else l->evict = 0; // LRU case
-        if (l->dbit == 1) {
-            l->dbit = 0;
-            if (!vcache) countDown = 150;
-        } else if (!vcache) countDown = 100;
+        if (getBit(dirty, index)) {
+            clearBit(dirty, index);
+            if (v <= 0) latency = 150;
+        } else if (v <= 0) latency = 100;
         printv("Got conflict cache miss, evicted entry in set %d at index %d\n", set, index);
-    } if (store) l->dbit = 1;
+    } if (store) setBit(dirty, index);
+    return latency;
 }
 
 void memoryRequest(trace_op* op, int processorNum, int64_t tag,
@@ -165,6 +373,18 @@ void memoryRequest(trace_op* op, int processorNum, int64_t tag,
     assert(op != NULL);
     assert(callback != NULL);
 
+    unsigned long addr = op->memAddress;
+    bool store = op->op == MEM_STORE;
+    uint64_t nextUse = nextUseFile ? readNextUse() : NEXTUSE_NEVER;
+    if (sweep) sweepAccess(addr, nextUse, !CADSS_FUNCTIONAL);
+
+    // with MSHRs the requests are tracked by the MSHR file instead of pending
+    if (mshrs > 0 && !CADSS_FUNCTIONAL) {
+        mshrRequest(&(mshr_op){.addr = addr, .store = store, .nextUse = nextUse, .pc = op->pcAddress,
+            .req = {.tag = tag, .procNum = processorNum, .memCallback = callback}});
+        return;
+    }
+
     // Simple model to only have one outstanding memory operation
     if (countDown != 0)
     {
@@ -175,70 +395,143 @@ void memoryRequest(trace_op* op, int processorNum, int64_t tag,
     pending = (pendingRequest){
         .tag = tag, .procNum = processorNum, .memCallback = callback};
 
-    // handle the cache operation here to determine countdown based on hit or miss
-    unsigned long addr = op->memAddress;
-    bool store = op->op == MEM_STORE;
+    // handle the cache operation here to determine countdown based on hit or miss,
+    // the sharded mode answers in one tick and leaves the lookup to its threads
+    int latency = 1;
+    if (threads > 0) shardSubmit(addr, store, op->pcAddress, nextUse, !CADSS_FUNCTIONAL);
+    else latency = cacheAccess(addr, store, op->pcAddress, nextUse, CADSS_FUNCTIONAL ? NULL : &stats);
+    if (latency) countDown = latency;
+
+    // functional warmup only updates the cache state, so respond right away
+    if (CADSS_FUNCTIONAL) {
+        countDown = 0;
+        pending.memCallback = NULL;
+        callback(processorNum, tag);
+        return;
+    }
+
+    if (countDown == 0) countDown = 1;
+    printv("Setting countdown to %d\n\n", countDown);
+}
+
+// the MSHR file's view of cacheAccess, the annotations were read on arrival
+int mshrAccess(const mshr_op *op) {
+    return cacheAccess(op->addr, op->store, op->pc, op->nextUse, &stats);
+}
+
+// whether addr would be answered within a tick, without touching the cache:
+// it is cached and not a prefetch still on its way.  A victim cache hit may
+// push a line out of the victim cache, so it counts as a miss here.
+bool cacheProbe(unsigned long addr) {
+    addr >>= b;
+    unsigned long cacheTag = addr >> s;
+    unsigned long set = s == 0 ? 0 : addr << (64 - s) >> (64 - s);
+    int index = findTag(&self->tags[set * self->ways], &self->vbits[set * self->words], cacheTag);
+    if (index == -1) return false;
+    return !self->pbits || !getBit(&self->pbits[set * self->words], index) || self->ready[set * E + index] <= now;
+}
+
+// Brings a line in for a prefetcher through the same fill path as a demand
+// miss, unless it is cached already.  Only prefetches made while counting are
+// tracked, earlier ones look like demand fills.
+static void prefetchFill(unsigned long lineAddr, unsigned long pc, bool count) {
+    unsigned long cacheTag = lineAddr >> s;
+    unsigned long set = s == 0 ? 0 : lineAddr << (64 - s) >> (64 - s);
+    uint64_t *valid = &self->vbits[set * self->words];
+    uint64_t *prefetched = &self->pbits[set * self->words];
+    if (findTag(&self->tags[set * self->ways], valid, cacheTag) != -1) return;
+    if (v > 0 && vcacheHas(lineAddr)) return;
+
+    // OPT does not know when a prefetched line is used
+    repl_access a = {.line = lineAddr, .pc = pc, .nextUse = NEXTUSE_NEVER};
+    printv("Prefetching line 0x%lx: ", lineAddr);
+    int index = firstEmpty(valid);
+    if (index != -1) handleColdMiss(cacheTag, set, index, false, NULL, &a);
+    else {
+        index = policy->chooseVictim(replState(set), set);
+        if (getBit(prefetched, index)) pf.useless++;
+        handleConflictMiss(cacheTag, set, index, false, NULL, &a);
+    }
+
+    if (count) {
+        setBit(prefetched, index);
+        pf.issued++;
+    } else clearBit(prefetched, index);
+    self->ready[set * E + index] = now + PREFETCH_LATENCY;
+}
+
+// Looks the address up and updates the cache.  Returns the latency of the access,
+// 0 when it does not change the countdown.  pc and nextUse describe the access
+// for the replacement policy, st collects the outcome, it is NULL while warming
+// up.
+int cacheAccess(unsigned long addr, bool store, unsigned long pc, uint64_t nextUse, cache_stats *st) {
     addr >>= b;
     unsigned long cacheTag = addr >> s;
     unsigned long set = s == 0 ? 0 : addr << (64 - s) >> (64 - s);
     printv("Operation type: %s, tag: 0x%lx, set: %lu, ", store ? "store" : "load", cacheTag, set);
-    int emptyIndex = -1; // denotes cold miss if not -1
-    int matchIndex = -1; // denotes cache hit if not -1
-    int evictVal = -1; // if neither cache hit or cold miss, then must be conflict miss
-    int evictIndex = -1; // use LRUIndex in case of conflict miss
-
-    // first pass through the main cache: checks to see if hit, cold miss, or conflict miss
-    for (int j = 0; j < E; j++) {
-        line *l = &self->cache[set][j];
-        if (l->vbit == 0 && emptyIndex == -1) emptyIndex = j;
-        else if (l->vbit == 1) {
-            if (l->tag == cacheTag && matchIndex == -1) matchIndex = j;
-            if (l->evict > evictVal) {
-                evictVal = l->evict;
-                evictIndex = j;
-            }
-        }
-    } 
+    uint64_t *valid = &self->vbits[set * self->words];
+    int emptyIndex = firstEmpty(valid); // denotes cold miss if not -1
+    int matchIndex = findTag(&self->tags[set * self->ways], valid, cacheTag); // denotes cache hit if not -1
+    int evictIndex = -1; // if neither cache hit or cold miss, then must be conflict miss
+
+    // only a conflict miss needs the replacement candidate, and then every way is valid
+    if (matchIndex == -1 && emptyIndex == -1) evictIndex = policy->chooseVictim(replState(set), set);
     
     // if first pass didn't result in a hit and victim cache is enabled: check victim cache
-    // if victim cache finds a hit: remove the entry from the victim cache but copy its contents.
-    // then have the victim cache entry be added via handleColdMiss or handleConflictMiss
+    // if victim cache finds a hit: take the entry out of the victim cache, then have it
+    // added via handleColdMiss or handleConflictMiss
+    line vcacheLine = {.tag = addr};
     line *vcacheHit = NULL;
-    if (vcache && matchIndex == -1) {
-        int vMatchIndex = -1;
-        for (int i = 0; i < v; i++) {
-            line *l = &vcache[i];
-            if (l->vbit == 1 && l->tag == cacheTag && vMatchIndex == -1) vMatchIndex = i;
-        } if (vMatchIndex != -1) {
-            line *l = &vcache[vMatchIndex];
-            vcacheHit = malloc(sizeof(line)); // create a copy of the vcache entry
-            vcacheHit->vbit = 1;
-            vcacheHit->dbit = l->dbit;
-            vcacheHit->tag = l->tag;
-            l->vbit = 0; // clear entry
-            l->dbit = 0;
-            l->evict = 0;
-            l->tag = 0;
+    if (v > 0 && matchIndex == -1 && vcacheTake(addr, &vcacheLine.dirty)) vcacheHit = &vcacheLine;
+    
+    // a miss, or the first use of a prefetched line, triggers the prefetcher
+    bool trigger = matchIndex == -1;
+    unsigned long lateBy = 0;
+    if (self->pbits) {
+        uint64_t *prefetched = &self->pbits[set * self->words];
+        if (matchIndex != -1 && getBit(prefetched, matchIndex)) {
+            unsigned long ready = self->ready[set * E + matchIndex];
+            clearBit(prefetched, matchIndex);
+            trigger = true;
+            pf.useful++;
+            if (ready > now) {
+                pf.late++;
+                lateBy = ready - now;
+            }
+        } else if (evictIndex != -1 && getBit(prefetched, evictIndex)) {
+            clearBit(prefetched, evictIndex);
+            pf.useless++;
         }
     }
-    
-    for (int j = 0; j < E; j++) {
-        line *l = &self->cache[set][j];
-        if (k == -1) ++l->evict; // LRU case: increment all LRU counters by 1
-        else if (matchIndex == -1 && emptyIndex == -1) 
-            l->evict += pow2(k) - 1 - evictVal; // RRPV case: increment all RRPVs until at least one reaches 2^k - 1
+
+    printv("match index: %d, empty index: %d, evict index: %d\n", matchIndex, emptyIndex, evictIndex);
+    repl_access a = {.line = addr, .pc = pc, .nextUse = nextUse, .recent = vcacheHit != NULL};
+    int latency;
+    if (matchIndex != -1) latency = handleHit(set, matchIndex, store, &a);
+    else if (emptyIndex != -1) latency = handleColdMiss(cacheTag, set, emptyIndex, store, vcacheHit, &a);
+    else latency = handleConflictMiss(cacheTag, set, evictIndex, store, vcacheHit, &a);
+    if ((unsigned long)latency < lateBy) latency = lateBy; // waits for the prefetch
+
+    if (pfKind != PF_NONE) {
+        unsigned long lines[PREFETCH_MAX_DEGREE];
+        int n = prefetchObserve(addr, pc, trigger, lines);
+        for (int i = 0; i < n; i++) prefetchFill(lines[i], pc, st != NULL);
     }
-    
-    printv("match index: %d, empty index: %d, LRU/RRPV value: %d, evict index: %d\n", matchIndex, emptyIndex, evictVal, evictIndex);
-    if (matchIndex != -1) handleHit(set, matchIndex, store);
-    else if (emptyIndex != -1) handleColdMiss(cacheTag, set, emptyIndex, store, vcacheHit);
-    else handleConflictMiss(cacheTag, set, evictIndex, store, vcacheHit);
-    if (countDown == 0) countDown = 1;
-    printv("Setting countdown to %d\n\n", countDown);
+
+    if (st) {
+        if (matchIndex != -1) st->hits++;
+        else st->misses++;
+        if (matchIndex == -1 && emptyIndex == -1) st->evictions++;
+        st->latency += latency ? latency : 1;
+        if (heatTop > 0) heatmapAccess(addr << b, matchIndex == -1);
+    }
+    return latency;
 }
 
 int tick()
 {
+    if (!CADSS_FUNCTIONAL) now++;
+    if (mshrs > 0) mshrTick();
     if (countDown > 0)
     {
         countDown--;
@@ -254,11 +547,48 @@ int tick()
 
 int finish(int outFd)
 {
+    char buf[128];
+    int n;
+    if (threads > 0) shardFinish(&stats);
+    n = snprintf(buf, sizeof(buf), "hits:%lu misses:%lu evictions:%lu\n", stats.hits, stats.misses, stats.evictions);
+    (void)!write(outFd, buf, n);
+    if (threads > 0) { // every access was answered in one tick
+        unsigned long accesses = stats.hits + stats.misses;
+        n = snprintf(buf, sizeof(buf), "Sharded run, add %lu ticks of cache latency\n", stats.latency - accesses);
+        (void)!write(outFd, buf, n);
+    }
+    if (mshrs > 0) mshrReport(outFd);
+    if (pfKind != PF_NONE) {
+        // accuracy: useful / issued, coverage: misses removed / misses without
+        // prefetching, timeliness: useful prefetches that were not late
+        double useful = pf.useful;
+        double accuracy = pf.issued ? useful / pf.issued : 0.0;
+        double coverage = pf.useful + stats.misses ? useful / (pf.useful + stats.misses) : 0.0;
+        double timeliness = pf.useful ? (useful - pf.late) / useful : 0.0;
+        n = snprintf(buf, sizeof(buf), "prefetch issued:%lu useful:%lu late:%lu useless:%lu\n",
+                     pf.issued, pf.useful, pf.late, pf.useless);
+        (void)!write(outFd, buf, n);
+        n = snprintf(buf, sizeof(buf), "prefetch accuracy:%.3f coverage:%.3f timeliness:%.3f\n",
+                     accuracy, coverage, timeliness);
+        (void)!write(outFd, buf, n);
+    }
+    if (heatTop > 0) heatmapReport(outFd);
+    if (sweep) sweepReport(outFd);
     return 0;
 }
 
 int destroy(void)
 {
     // free any internally allocated memory here
+    free(self->tags);
+    if (v > 0) vcacheDestroy();
+    if (heatTop > 0) heatmapDestroy();
+    sweepDestroy();
+    if (mshrs > 0) mshrDestroy();
+    free(self->pbits);
+    free(self->ready);
+    if (nextUseFile) fclose(nextUseFile);
+    if (policy->destroy) policy->destroy();
+    free(self);
     return 0;
 }
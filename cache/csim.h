@@ -1,6 +1,7 @@
 #ifndef CSIM_H
 #define CSIM_H
 
+#include <stdbool.h>
 #include "trace.h"
 #include "coherence.h"
 
@@ -10,18 +11,50 @@ typedef struct _cache_sim_args {
     coher* coherComp;
 } cache_sim_args;
 
-// representation of a single cache line
+// helpers for the per-set valid / dirty bitmasks
+static inline int getBit(const uint64_t *bits, int j) { return (bits[j >> 6] >> (j & 63)) & 1; }
+static inline void setBit(uint64_t *bits, int j) { bits[j >> 6] |= 1UL << (j & 63); }
+static inline void clearBit(uint64_t *bits, int j) { bits[j >> 6] &= ~(1UL << (j & 63)); }
+
+// a line taken out of the victim cache (see vcache.c), tag is its line address
 typedef struct {
-    short vbit;
-    short dbit;
-    int evict; // used as either LRU counter or RRPV, depending on the mode
     unsigned long tag;
+    bool dirty;
 } line;
 
+// a request waiting for its callback
+typedef struct _pendingRequest {
+    int64_t tag;
+    int procNum;
+    void (*memCallback)(int, int64_t);
+} pendingRequest;
+
+// outcome counters, also kept per thread by the sharded mode (shard.c)
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long latency; // sum of the access latencies, in ticks
+} cache_stats;
+
+// The main cache is stored as structure-of-arrays in one contiguous allocation.
+// Each set owns a row of "ways" tags (E rounded up to the SIMD width, the padding
+// is never valid), "words" 64-bit words of valid and dirty bits, and "replWords"
+// words of replacement state.  Set i's row starts at i * ways (tags), i * words
+// (bits) and i * replWords (replacement).
 typedef struct _csim {
     sim_interface si;
     void (*memoryRequest)(trace_op*, int, int64_t, void(*callback)(int, int64_t));
-    line **cache;
+    debug_env_vars dbgEnv;
+    unsigned long *tags;
+    uint64_t *vbits;
+    uint64_t *dbits;
+    uint64_t *repl;
+    uint64_t *pbits; // prefetched and not used yet, only when prefetching
+    unsigned long *ready; // tick each prefetched way's fill completes, S * E
+    int ways;
+    int words;
+    int replWords;
 } csim;
 
 #endif
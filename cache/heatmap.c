@@ -0,0 +1,218 @@
+#include "heatmap.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Counts are kept in count-min sketches: DEPTH rows of WIDTH counters, each
+// row hashed differently, and a key's estimate is the smallest of its DEPTH
+// counters.  Estimates never undercount, and overcount by more than
+// e * total / WIDTH only with probability e^-DEPTH.
+//
+// The hottest keys are kept in a min-heap of the top ones seen so far.  A key
+// that is not in the heap replaces the coldest one once its estimate passes
+// it, so only the heap and the sketches grow with -H, not with the trace.  A
+// small open-addressed index, at most half full, finds a key's place in the
+// heap, so a miss costs a probe and a sift rather than a scan of the heap.
+// Lines are ranked by misses, pages by misses with their accesses alongside
+// for the miss rate.
+
+#define DEPTH 4
+#define WIDTH_BITS 14
+#define WIDTH (1 << WIDTH_BITS)
+#define PAGE_BITS 12
+
+typedef struct {
+    uint64_t counts[DEPTH][WIDTH];
+} sketch;
+
+typedef struct {
+    unsigned long key;
+    uint64_t count;
+    int slot; // in the index
+} hot;
+
+typedef struct {
+    hot *heap; // min-heap on count
+    int size;
+    int *index; // heap position of each key, -1 when the slot is empty
+    int indexBits;
+} top_list;
+
+static const uint64_t seeds[DEPTH] = {0x9E3779B97F4A7C15UL, 0xC2B2AE3D27D4EB4FUL, 0x165667B19E3779F9UL,
+                                      0xD6E8FEB86659FD93UL};
+
+static sketch *lineMisses = NULL, *pageMisses = NULL, *pageAccesses = NULL;
+static top_list hotLines, hotPages;
+static int topSize = 0;
+static uint64_t accesses = 0, misses = 0;
+
+static inline unsigned slot(unsigned long key, int row) {
+    return ((key ^ (key >> 31)) * seeds[row]) >> (64 - WIDTH_BITS);
+}
+
+// adds one to key's counters, returns its new estimate
+static uint64_t sketchAdd(sketch *sk, unsigned long key) {
+    uint64_t estimate = UINT64_MAX;
+    for (int r = 0; r < DEPTH; r++) {
+        uint64_t c = ++sk->counts[r][slot(key, r)];
+        if (c < estimate) estimate = c;
+    }
+    return estimate;
+}
+
+static uint64_t sketchCount(const sketch *sk, unsigned long key) {
+    uint64_t estimate = UINT64_MAX;
+    for (int r = 0; r < DEPTH; r++)
+        if (sk->counts[r][slot(key, r)] < estimate) estimate = sk->counts[r][slot(key, r)];
+    return estimate;
+}
+
+static inline unsigned indexHome(const top_list *t, unsigned long key) {
+    return ((key ^ (key >> 31)) * seeds[0]) >> (64 - t->indexBits);
+}
+
+// The slot holding key, or the empty slot where it would go
+static unsigned indexProbe(const top_list *t, unsigned long key) {
+    unsigned mask = (1U << t->indexBits) - 1;
+    unsigned slot = indexHome(t, key);
+    while (t->index[slot] != -1 && t->heap[t->index[slot]].key != key) slot = (slot + 1) & mask;
+    return slot;
+}
+
+// Empties slot, moving back the keys after it that probed past it
+static void indexRemove(top_list *t, unsigned slot) {
+    unsigned mask = (1U << t->indexBits) - 1;
+    unsigned next = slot;
+    t->index[slot] = -1;
+    for (;;) {
+        next = (next + 1) & mask;
+        if (t->index[next] == -1) return;
+        unsigned home = indexHome(t, t->heap[t->index[next]].key);
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            t->index[slot] = t->index[next];
+            t->heap[t->index[slot]].slot = slot;
+            t->index[next] = -1;
+            slot = next;
+        }
+    }
+}
+
+// puts key at heap position i, the slot must be the empty one indexProbe found
+static void place(top_list *t, int i, unsigned slot, unsigned long key, uint64_t count) {
+    t->heap[i] = (hot){key, count, slot};
+    t->index[slot] = i;
+}
+
+static void swap(top_list *t, int i, int j) {
+    hot tmp = t->heap[i];
+    t->heap[i] = t->heap[j];
+    t->heap[j] = tmp;
+    t->index[t->heap[i].slot] = i;
+    t->index[t->heap[j].slot] = j;
+}
+
+static void siftDown(top_list *t, int i) {
+    for (;;) {
+        int least = i, l = 2 * i + 1, r = l + 1;
+        if (l < t->size && t->heap[l].count < t->heap[least].count) least = l;
+        if (r < t->size && t->heap[r].count < t->heap[least].count) least = r;
+        if (least == i) return;
+        swap(t, i, least);
+        i = least;
+    }
+}
+
+static void siftUp(top_list *t, int i) {
+    while (i > 0 && t->heap[(i - 1) / 2].count > t->heap[i].count) {
+        swap(t, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void topOffer(top_list *t, unsigned long key, uint64_t count) {
+    unsigned slot = indexProbe(t, key);
+    if (t->index[slot] != -1) {
+        int i = t->index[slot];
+        t->heap[i].count = count; // counts only grow
+        siftDown(t, i);
+        return;
+    }
+    if (t->size < topSize) {
+        place(t, t->size, slot, key, count);
+        siftUp(t, t->size++);
+    } else if (count > t->heap[0].count) {
+        indexRemove(t, t->heap[0].slot);
+        place(t, 0, indexProbe(t, key), key, count);
+        siftDown(t, 0);
+    }
+}
+
+static top_list topInit(void) {
+    top_list t = {calloc(topSize, sizeof(hot)), 0, NULL, 1};
+    while ((1 << t.indexBits) < 2 * topSize) t.indexBits++;
+    t.index = malloc(sizeof(int) << t.indexBits);
+    for (int i = 0; i < 1 << t.indexBits; i++) t.index[i] = -1;
+    return t;
+}
+
+void heatmapInit(int top) {
+    topSize = top < 1 ? 1 : top > HEATMAP_MAX_TOP ? HEATMAP_MAX_TOP : top;
+    lineMisses = calloc(1, sizeof(sketch));
+    pageMisses = calloc(1, sizeof(sketch));
+    pageAccesses = calloc(1, sizeof(sketch));
+    hotLines = topInit();
+    hotPages = topInit();
+}
+
+// addr is the address of the line
+void heatmapAccess(unsigned long addr, bool miss) {
+    unsigned long page = addr >> PAGE_BITS;
+    accesses++;
+    sketchAdd(pageAccesses, page);
+    if (!miss) return;
+    misses++;
+    topOffer(&hotLines, addr, sketchAdd(lineMisses, addr));
+    topOffer(&hotPages, page, sketchAdd(pageMisses, page));
+}
+
+static int byCount(const void *a, const void *b) {
+    uint64_t x = ((const hot *)a)->count, y = ((const hot *)b)->count;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void heatmapReport(int outFd) {
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf), "heatmap accesses:%lu misses:%lu, estimated counts, hottest first\n",
+                     accesses, misses);
+    (void)!write(outFd, buf, n);
+
+    // sorting the heaps leaves their indexes stale, the report comes last
+    qsort(hotLines.heap, hotLines.size, sizeof(hot), byCount);
+    for (int i = 0; i < hotLines.size; i++) {
+        n = snprintf(buf, sizeof(buf), "hot line 0x%lx misses:%lu\n", hotLines.heap[i].key, hotLines.heap[i].count);
+        (void)!write(outFd, buf, n);
+    }
+
+    qsort(hotPages.heap, hotPages.size, sizeof(hot), byCount);
+    for (int i = 0; i < hotPages.size; i++) {
+        unsigned long page = hotPages.heap[i].key;
+        uint64_t pageMissCount = hotPages.heap[i].count;
+        uint64_t pageAccessCount = sketchCount(pageAccesses, page);
+        if (pageAccessCount < pageMissCount) pageAccessCount = pageMissCount; // both are overestimates
+        n = snprintf(buf, sizeof(buf), "hot page 0x%lx misses:%lu accesses:%lu miss rate:%.3f\n",
+                     page << PAGE_BITS, pageMissCount, pageAccessCount, (double)pageMissCount / pageAccessCount);
+        (void)!write(outFd, buf, n);
+    }
+}
+
+void heatmapDestroy(void) {
+    free(lineMisses);
+    free(pageMisses);
+    free(pageAccesses);
+    free(hotLines.heap);
+    free(hotPages.heap);
+    free(hotLines.index);
+    free(hotPages.index);
+    lineMisses = pageMisses = pageAccesses = NULL;
+}
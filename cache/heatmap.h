@@ -0,0 +1,15 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdbool.h>
+
+// Miss heatmap, see heatmap.c.  Tracks the lines and 4K pages with the most
+// misses in bounded memory, however long the trace.
+#define HEATMAP_MAX_TOP 256
+
+void heatmapInit(int top);
+void heatmapAccess(unsigned long addr, bool miss);
+void heatmapReport(int outFd);
+void heatmapDestroy(void);
+
+#endif
@@ -0,0 +1,164 @@
+#include "mshr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Miss status holding registers.  Every outstanding miss owns one register,
+// keyed by its line, until its fill completes.  A later miss to a line that is
+// still being filled is merged into the register as another waiter instead of
+// going to memory again, and every waiter is called back when the fill is done.
+// Hits are answered on the next tick, even while misses are outstanding.
+// When every register is busy, requests that would not be answered on the next
+// tick (misses, and hits on prefetches still being filled) wait in order (and
+// everything behind them waits too) until one frees up.
+//
+// The cache state is updated when a request is accepted, as in the blocking
+// model, so a merged miss finds its line already present.
+
+typedef struct {
+    unsigned long line;
+    int countDown; // 0 when the register is free
+    int waiterCount;
+    int waiterSize;
+    pendingRequest *waiters;
+} mshr;
+
+typedef struct {
+    int count;
+    int size;
+    pendingRequest *reqs;
+} request_list;
+
+static mshr *file = NULL;
+static int mshrCount = 0;
+static int blockBits = 0;
+static mshr_access accessFn = NULL;
+static mshr_probe probeFn = NULL;
+
+static request_list ready = {0}; // hits, answered on the next tick
+static request_list answering = {0};
+
+static mshr_op *blocked = NULL; // ring buffer of requests waiting for a register
+static int blockedHead = 0, blockedCount = 0, blockedSize = 0;
+
+static unsigned long merges = 0, stalls = 0;
+
+static void listAppend(request_list *list, pendingRequest req) {
+    if (list->count == list->size) {
+        list->size = list->size ? 2 * list->size : 8;
+        list->reqs = realloc(list->reqs, sizeof(pendingRequest) * list->size);
+    }
+    list->reqs[list->count++] = req;
+}
+
+static void addWaiter(mshr *m, pendingRequest req) {
+    if (m->waiterCount == m->waiterSize) {
+        m->waiterSize = m->waiterSize ? 2 * m->waiterSize : 4;
+        m->waiters = realloc(m->waiters, sizeof(pendingRequest) * m->waiterSize);
+    }
+    m->waiters[m->waiterCount++] = req;
+}
+
+static mshr *findLine(unsigned long line) {
+    for (int i = 0; i < mshrCount; i++)
+        if (file[i].countDown && file[i].line == line) return &file[i];
+    return NULL;
+}
+
+static mshr *findFree(void) {
+    for (int i = 0; i < mshrCount; i++)
+        if (!file[i].countDown) return &file[i];
+    return NULL;
+}
+
+static void blockedPush(const mshr_op *op) {
+    if (blockedCount == blockedSize) {
+        int size = blockedSize ? 2 * blockedSize : 16;
+        mshr_op *grown = malloc(sizeof(mshr_op) * size);
+        for (int i = 0; i < blockedCount; i++) grown[i] = blocked[(blockedHead + i) % blockedSize];
+        free(blocked);
+        blocked = grown;
+        blockedSize = size;
+        blockedHead = 0;
+    }
+    blocked[(blockedHead + blockedCount++) % blockedSize] = *op;
+}
+
+// accepts op if it can be, returns false if it has to wait for a register
+static bool tryRequest(const mshr_op *op) {
+    unsigned long line = op->addr >> blockBits;
+    mshr *m = findLine(line);
+    if (m) { // secondary miss
+        accessFn(op);
+        addWaiter(m, op->req);
+        merges++;
+        return true;
+    }
+
+    m = findFree();
+    if (!m && !probeFn(op->addr)) return false;
+
+    int latency = accessFn(op);
+    if (latency <= 1) {
+        listAppend(&ready, op->req);
+        return true;
+    }
+    m->line = line; // probe said it takes longer, so a free register was found above
+    m->countDown = latency;
+    m->waiterCount = 0;
+    addWaiter(m, op->req);
+    return true;
+}
+
+void mshrInit(int n, int b, mshr_access access, mshr_probe probe) {
+    mshrCount = n;
+    blockBits = b;
+    accessFn = access;
+    probeFn = probe;
+    file = calloc(n, sizeof(mshr));
+}
+
+void mshrRequest(const mshr_op *op) {
+    if (blockedCount == 0 && tryRequest(op)) return;
+    blockedPush(op);
+    stalls++;
+}
+
+void mshrTick(void) {
+    // answer the hits from the previous tick; callbacks only record completion,
+    // so nothing is requested while the list is being walked
+    request_list done = ready;
+    ready = answering;
+    ready.count = 0;
+    for (int i = 0; i < done.count; i++) done.reqs[i].memCallback(done.reqs[i].procNum, done.reqs[i].tag);
+    answering = done;
+
+    bool freed = false;
+    for (int i = 0; i < mshrCount; i++) {
+        mshr *m = &file[i];
+        if (!m->countDown || --m->countDown) continue;
+        for (int j = 0; j < m->waiterCount; j++) m->waiters[j].memCallback(m->waiters[j].procNum, m->waiters[j].tag);
+        m->waiterCount = 0;
+        freed = true;
+    }
+
+    while (freed && blockedCount > 0 && tryRequest(&blocked[blockedHead])) {
+        blockedHead = (blockedHead + 1) % blockedSize;
+        blockedCount--;
+    }
+}
+
+void mshrReport(int outFd) {
+    char buf[96];
+    int n = snprintf(buf, sizeof(buf), "MSHR merges:%lu full stalls:%lu\n", merges, stalls);
+    (void)!write(outFd, buf, n);
+}
+
+void mshrDestroy(void) {
+    for (int i = 0; i < mshrCount; i++) free(file[i].waiters);
+    free(file);
+    free(ready.reqs);
+    free(answering.reqs);
+    free(blocked);
+    file = NULL;
+}
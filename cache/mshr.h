@@ -0,0 +1,28 @@
+#ifndef MSHR_H
+#define MSHR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csim.h"
+
+// A request handed to the MSHR file, see mshr.c
+typedef struct {
+    unsigned long addr;
+    bool store;
+    uint64_t nextUse;
+    unsigned long pc;
+    pendingRequest req;
+} mshr_op;
+
+// access performs the lookup and returns its latency, probe says without
+// changing any state whether that latency would be 0 or 1
+typedef int (*mshr_access)(const mshr_op *op);
+typedef bool (*mshr_probe)(unsigned long addr);
+
+void mshrInit(int n, int b, mshr_access access, mshr_probe probe);
+void mshrRequest(const mshr_op *op);
+void mshrTick(void);
+void mshrReport(int outFd);
+void mshrDestroy(void);
+
+#endif
@@ -0,0 +1,146 @@
+// cadss-nextuse - annotates every memory op of a trace with its next use
+//
+//   cadss-nextuse -b <block bits> [-w <horizon>] <trace> <annotation file>
+//
+// The trace is read once, forwards, and its line addresses spooled to a
+// temporary file.  That file is then walked backwards a chunk at a time with a
+// hash map from line to the most recent (i.e. next, in trace order) index, so
+// the whole pass is O(n) and only a chunk of the trace is ever in memory.
+// The map holds one entry per distinct line; with -w, entries more than
+// <horizon> ops away are dropped and those next uses recorded as never, which
+// bounds the map by the horizon instead.
+#include "nextuse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define CHUNK (1 << 16) // ops per read / write of the backward pass
+
+typedef struct {
+    uint64_t line;
+    uint64_t index; // NEXTUSE_NEVER marks an empty slot
+} slot;
+
+static slot *table = NULL;
+static uint64_t tableSize = 0; // power of 2
+static uint64_t used = 0;
+
+static uint64_t hashLine(uint64_t line) {
+    line ^= line >> 33;
+    line *= 0xff51afd7ed558ccdUL;
+    line ^= line >> 33;
+    return line;
+}
+
+static slot *lookup(uint64_t line) {
+    uint64_t i = hashLine(line) & (tableSize - 1);
+    while (table[i].index != NEXTUSE_NEVER && table[i].line != line) i = (i + 1) & (tableSize - 1);
+    return &table[i];
+}
+
+// reinserts every entry whose index is at most limit, into a table of newSize
+static void rebuild(uint64_t newSize, uint64_t limit) {
+    slot *old = table;
+    uint64_t oldSize = tableSize;
+    tableSize = newSize;
+    table = malloc(sizeof(slot) * tableSize);
+    for (uint64_t i = 0; i < tableSize; i++) table[i].index = NEXTUSE_NEVER;
+    used = 0;
+    for (uint64_t i = 0; i < oldSize; i++) {
+        if (old[i].index == NEXTUSE_NEVER || old[i].index > limit) continue;
+        *lookup(old[i].line) = old[i];
+        used++;
+    }
+    free(old);
+}
+
+int main(int argc, char **argv) {
+    int b = -1;
+    uint64_t horizon = 0;
+    int op;
+    while ((op = getopt(argc, argv, "b:w:")) != -1) {
+        switch (op) {
+            case 'b':
+                b = atoi(optarg);
+                break;
+            case 'w':
+                horizon = strtoull(optarg, NULL, 0);
+                break;
+        }
+    }
+    if (b < 0 || argc - optind != 2) {
+        fprintf(stderr, "usage: %s -b <block bits> [-w <horizon>] <trace> <annotation file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *trace = fopen(argv[optind], "r");
+    if (trace == NULL) {
+        perror("Attempt to open trace file");
+        return 1;
+    }
+    FILE *spool = tmpfile();
+    FILE *out = fopen(argv[optind + 1], "wb");
+    if (spool == NULL || out == NULL) {
+        perror("Attempt to create annotation file");
+        return 1;
+    }
+
+    // forward pass, the same memory ops in the same order that the cache sees
+    char buf[256];
+    uint64_t n = 0;
+    while (fgets(buf, sizeof(buf), trace)) {
+        uint64_t addr;
+        if ((buf[0] != 'L' && buf[0] != 'S') || sscanf(buf + 1, "%lx", &addr) != 1) continue;
+        uint64_t line = addr >> b;
+        fwrite(&line, sizeof(line), 1, spool);
+        n++;
+    }
+    fclose(trace);
+
+    nextuse_header header = {.blockBits = b, .horizon = horizon};
+    memcpy(header.magic, NEXTUSE_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, out);
+
+    // backward pass
+    uint64_t *lines = malloc(sizeof(uint64_t) * CHUNK);
+    uint64_t *next = malloc(sizeof(uint64_t) * CHUNK);
+    tableSize = 1024;
+    table = malloc(sizeof(slot) * tableSize);
+    for (uint64_t i = 0; i < tableSize; i++) table[i].index = NEXTUSE_NEVER;
+    for (uint64_t end = n; end > 0;) {
+        uint64_t start = end > CHUNK ? end - CHUNK : 0;
+        uint64_t count = end - start;
+        fseek(spool, start * sizeof(uint64_t), SEEK_SET);
+        if (fread(lines, sizeof(uint64_t), count, spool) != count) {
+            fprintf(stderr, "Failed to read back the spooled trace\n");
+            return 1;
+        }
+
+        for (uint64_t j = count; j-- > 0;) {
+            uint64_t i = start + j;
+            if (2 * (used + 1) > tableSize) {
+                uint64_t limit = horizon ? i + horizon : NEXTUSE_NEVER;
+                if (horizon) rebuild(tableSize, limit); // drop what is out of reach first
+                if (4 * (used + 1) > tableSize) rebuild(2 * tableSize, limit);
+            }
+            slot *sl = lookup(lines[j]);
+            if (sl->index == NEXTUSE_NEVER) used++;
+            next[j] = (horizon && sl->index - i > horizon) ? NEXTUSE_NEVER : sl->index;
+            sl->line = lines[j];
+            sl->index = i;
+        }
+
+        fseek(out, sizeof(header) + start * sizeof(uint64_t), SEEK_SET);
+        fwrite(next, sizeof(uint64_t), count, out);
+        end = start;
+    }
+
+    printf("Annotated %lu memory ops, %lu lines tracked at the end\n", n, used);
+    free(lines);
+    free(next);
+    free(table);
+    fclose(spool);
+    fclose(out);
+    return 0;
+}
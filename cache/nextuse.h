@@ -0,0 +1,20 @@
+#ifndef NEXTUSE_H
+#define NEXTUSE_H
+
+#include <stdint.h>
+
+// Next-use annotation files, written by cadss-nextuse and read by the cache for
+// OPT replacement.  After the header there is one little endian uint64_t per
+// memory op of the trace, in trace order: the index (counting memory ops from 0)
+// of the next op that touches the same line, or NEXTUSE_NEVER.
+#define NEXTUSE_MAGIC "CADSSNU1"
+#define NEXTUSE_NEVER UINT64_MAX
+
+typedef struct {
+    char magic[8];
+    uint32_t blockBits; // lines are addr >> blockBits
+    uint32_t reserved;
+    uint64_t horizon; // 0, or next uses further away than this were dropped
+} nextuse_header;
+
+#endif
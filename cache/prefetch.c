@@ -0,0 +1,106 @@
+#include "prefetch.h"
+#include <stdio.h>
+#include <string.h>
+
+// nextline - on a trigger, the next degree lines
+// stride   - a table of the last line and stride seen by each PC, once the same
+//            stride was seen twice in a row, the next degree lines along it.
+//            Without PCs in the trace every access shares one entry.
+// stream   - a few trackers of misses to nearby lines, once one has moved twice
+//            in the same direction, the next degree lines in that direction.
+
+#define STRIDE_ENTRIES 256
+#define STREAMS 8
+#define STREAM_WINDOW 4 // lines a trigger may be from a stream to continue it
+
+typedef struct {
+    unsigned long pc;
+    unsigned long last;
+    long stride;
+    int confidence; // 0 - 3
+} stride_entry;
+
+typedef struct {
+    unsigned long last;
+    int direction; // -1, 0 when not known yet, or 1
+    int confidence;
+    unsigned long lastUse; // for replacing the least recently used tracker
+} stream_entry;
+
+static prefetch_kind kind = PF_NONE;
+static int degree = 1;
+static stride_entry strides[STRIDE_ENTRIES];
+static stream_entry streams[STREAMS];
+static unsigned long triggers = 0;
+
+prefetch_kind prefetchKind(const char *name) {
+    if (strcmp(name, "nextline") == 0) return PF_NEXTLINE;
+    if (strcmp(name, "stride") == 0) return PF_STRIDE;
+    if (strcmp(name, "stream") == 0) return PF_STREAM;
+    if (strcmp(name, "none") != 0) fprintf(stderr, "Unknown prefetcher %s, not prefetching\n", name);
+    return PF_NONE;
+}
+
+void prefetchInit(prefetch_kind k, int d) {
+    kind = k;
+    degree = d < 1 ? 1 : d > PREFETCH_MAX_DEGREE ? PREFETCH_MAX_DEGREE : d;
+    memset(strides, 0, sizeof(strides));
+    memset(streams, 0, sizeof(streams));
+}
+
+static int run(unsigned long line, long step, unsigned long *lines) {
+    for (int i = 0; i < degree; i++) lines[i] = line + step * (i + 1);
+    return degree;
+}
+
+static int strideObserve(unsigned long line, unsigned long pc, unsigned long *lines) {
+    stride_entry *e = &strides[(pc ^ (pc >> 8)) % STRIDE_ENTRIES];
+    if (e->pc != pc || e->last == 0) {
+        *e = (stride_entry){.pc = pc, .last = line};
+        return 0;
+    }
+    long delta = (long)(line - e->last);
+    e->last = line;
+    if (delta == 0) return 0;
+    if (delta == e->stride) {
+        if (e->confidence < 3) e->confidence++;
+    } else if (e->confidence > 0) {
+        e->confidence--;
+    } else {
+        e->stride = delta;
+    }
+    return e->confidence >= 2 ? run(line, e->stride, lines) : 0;
+}
+
+static int streamObserve(unsigned long line, unsigned long *lines) {
+    stream_entry *lru = &streams[0];
+    triggers++;
+    for (int i = 0; i < STREAMS; i++) {
+        stream_entry *st = &streams[i];
+        long delta = (long)(line - st->last);
+        if (st->lastUse && delta != 0 && delta >= -STREAM_WINDOW && delta <= STREAM_WINDOW) {
+            int direction = delta > 0 ? 1 : -1;
+            if (direction == st->direction) {
+                if (st->confidence < 3) st->confidence++;
+            } else {
+                st->direction = direction;
+                st->confidence = 0;
+            }
+            st->last = line;
+            st->lastUse = triggers;
+            return st->confidence >= 1 ? run(line, st->direction, lines) : 0;
+        }
+        if (st->lastUse < lru->lastUse) lru = st;
+    }
+    *lru = (stream_entry){.last = line, .lastUse = triggers};
+    return 0;
+}
+
+int prefetchObserve(unsigned long line, unsigned long pc, bool trigger, unsigned long *lines) {
+    switch (kind) {
+        case PF_NEXTLINE: return trigger ? run(line, 1, lines) : 0;
+        case PF_STRIDE: return strideObserve(line, pc, lines);
+        case PF_STREAM: return trigger ? streamObserve(line, lines) : 0;
+        default: return 0;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+
+// Hardware prefetchers, see prefetch.c.  They work on line addresses
+// (addr >> b) and only suggest lines, the cache does the fills.
+typedef enum { PF_NONE, PF_NEXTLINE, PF_STRIDE, PF_STREAM } prefetch_kind;
+
+#define PREFETCH_MAX_DEGREE 16
+
+prefetch_kind prefetchKind(const char *name);
+void prefetchInit(prefetch_kind kind, int degree);
+
+// Called for each demand access.  trigger is a miss, or the first hit on a
+// prefetched line.  Fills lines[] and returns how many lines to prefetch.
+int prefetchObserve(unsigned long line, unsigned long pc, bool trigger, unsigned long *lines);
+
+#endif
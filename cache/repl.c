@@ -0,0 +1,343 @@
+#include "repl.h"
+#include "csim.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The state each policy keeps per set:
+//  LRU     - a doubly linked list of the valid ways, ordered by age (MRU first),
+//            stored as ints: [0] MRU way, [1] LRU way, then next[E], then prev[E]
+//  PLRU    - the E - 1 node bits of a binary tree, node n (root is 1) at bit n,
+//            each bit points towards the less recently used half
+//  RRIP    - the RRPVs bit-sliced into k planes of E bits, so that every way
+//            is read or aged with a few word operations
+//  OPT     - the next use of each way, Belady's choice is the furthest one
+//  SHiP    - a word per way: RRPV, whether the line was reused, and the
+//            signature that filled it
+//  Hawkeye - a word per way: RRPV and the signature of its last access
+//
+// SHiP and Hawkeye learn per signature, the PC of the access.  The memory
+// traces have no PCs, so without one the signature is the memory region
+// (256 lines) the line is in, as in SHiP-Mem.
+
+static int E, k, words, rrpvMax;
+
+static unsigned signature(const repl_access *a, int bits) {
+    unsigned long key = a->pc ? a->pc : a->line >> 8;
+    key ^= key >> 29;
+    return (key * 0x9E3779B97F4A7C15UL) >> (64 - bits);
+}
+
+// LRU
+
+static int lruInit(int S, int E_, int k_) {
+    E = E_;
+    return E + 1; // 2E + 2 ints
+}
+
+static void lruReset(uint64_t *state) {
+    int *list = (int *)state;
+    list[0] = list[1] = -1;
+}
+
+static void lruUnlink(uint64_t *state, int set, int way) {
+    int *list = (int *)state, *next = list + 2, *prev = list + 2 + E;
+    if (prev[way] != -1) next[prev[way]] = next[way];
+    else list[0] = next[way];
+    if (next[way] != -1) prev[next[way]] = prev[way];
+    else list[1] = prev[way];
+}
+
+static void lruPushFront(uint64_t *state, int set, int way, const repl_access *a) {
+    int *list = (int *)state, *next = list + 2, *prev = list + 2 + E;
+    prev[way] = -1;
+    next[way] = list[0];
+    if (list[0] != -1) prev[list[0]] = way;
+    else list[1] = way;
+    list[0] = way;
+}
+
+static void lruHit(uint64_t *state, int set, int way, const repl_access *a) {
+    if (((int *)state)[0] == way) return;
+    lruUnlink(state, set, way);
+    lruPushFront(state, set, way, a);
+}
+
+static int lruVictim(uint64_t *state, int set) { return ((int *)state)[1]; }
+
+const repl_policy replLRU = {"lru", lruInit, lruReset, lruHit, lruPushFront, lruVictim, lruUnlink};
+
+// Tree-PLRU
+
+static int plruInit(int S, int E_, int k_) {
+    E = E_;
+    return words = (E + 63) / 64;
+}
+
+static void plruTouch(uint64_t *tree, int set, int way, const repl_access *a) {
+    int node = 1;
+    for (int half = E >> 1; half > 0; half >>= 1) {
+        int right = (way & half) != 0;
+        if (right) clearBit(tree, node); // point at the left half
+        else setBit(tree, node);
+        node = 2 * node + right;
+    }
+}
+
+static int plruVictim(uint64_t *tree, int set) {
+    int node = 1;
+    while (node < E) node = 2 * node + getBit(tree, node);
+    return node - E;
+}
+
+static void noEvict(uint64_t *state, int set, int way) {}
+
+const repl_policy replPLRU = {"plru", plruInit, NULL, plruTouch, plruTouch, plruVictim, noEvict};
+
+// RRIP, hits get an RRPV of 0 and fills 2^k - 1 (distant), unless the line
+// comes back from the victim cache
+
+static int rripInit(int S, int E_, int k_) {
+    E = E_;
+    k = k_;
+    rrpvMax = (1 << k) - 1;
+    words = (E + 63) / 64;
+    return k * words;
+}
+
+static void rrpvSet(uint64_t *planes, int way, int val) {
+    for (int i = 0; i < k; i++, planes += words) {
+        if ((val >> i) & 1) setBit(planes, way);
+        else clearBit(planes, way);
+    }
+}
+
+static void rripHit(uint64_t *planes, int set, int way, const repl_access *a) { rrpvSet(planes, way, 0); }
+
+static void rripFill(uint64_t *planes, int set, int way, const repl_access *a) {
+    rrpvSet(planes, way, a->recent ? 0 : rrpvMax);
+}
+
+// Finds the first way with the largest RRPV, then ages every way by the same
+// amount so that it reaches 2^k - 1, which is what repeatedly incrementing all
+// RRPVs until one saturates would do.
+static int rripVictim(uint64_t *planes, int set) {
+    int W = words;
+    uint64_t cand[W];
+    int maxVal = 0;
+    for (int w = 0; w < W; w++) cand[w] = ~0UL;
+    if (E & 63) cand[W - 1] = (1UL << (E & 63)) - 1;
+
+    // narrow the candidates from the most significant plane down
+    for (int i = k - 1; i >= 0; i--) {
+        uint64_t *plane = planes + i * W;
+        uint64_t any = 0;
+        for (int w = 0; w < W; w++) any |= cand[w] & plane[w];
+        if (!any) continue;
+        maxVal |= 1 << i;
+        for (int w = 0; w < W; w++) cand[w] &= plane[w];
+    }
+
+    // bit-sliced add of (2^k - 1 - maxVal) to every way, no way can overflow
+    int age = rrpvMax - maxVal;
+    if (age) {
+        for (int w = 0; w < W; w++) {
+            uint64_t carry = 0;
+            for (int i = 0; i < k; i++) {
+                uint64_t p = planes[i * W + w];
+                uint64_t a = ((age >> i) & 1) ? ~0UL : 0;
+                planes[i * W + w] = p ^ a ^ carry;
+                carry = (p & a) | (carry & (p ^ a));
+            }
+        }
+    }
+
+    for (int w = 0; w < W; w++)
+        if (cand[w]) return (w << 6) + __builtin_ctzl(cand[w]);
+    return -1;
+}
+
+const repl_policy replRRIP = {"rrip", rripInit, NULL, rripHit, rripFill, rripVictim, noEvict};
+
+// Belady's OPT, from the next-use annotations
+
+static int optInit(int S, int E_, int k_) {
+    E = E_;
+    return E;
+}
+
+static void optTouch(uint64_t *state, int set, int way, const repl_access *a) { state[way] = a->nextUse; }
+
+static int optVictim(uint64_t *state, int set) {
+    int victim = 0;
+    for (int j = 1; j < E; j++)
+        if (state[j] > state[victim]) victim = j;
+    return victim;
+}
+
+const repl_policy replOPT = {"opt", optInit, NULL, optTouch, optTouch, optVictim, noEvict};
+
+// The SHiP and Hawkeye way words: RRPV in the low byte, so k is at most 8,
+// flags in the next one, the signature above them
+
+#define WAY_RRPV(w) ((int)((w) & 0xff))
+#define WAY_REUSED 0x100
+#define WAY_SIG(w) ((unsigned)((w) >> 16))
+#define WAY(rrpv, flags, sig) ((uint64_t)(rrpv) | (flags) | (uint64_t)(sig) << 16)
+
+// the way with the largest RRPV, aging every way until it reaches rrpvMax
+static int wayVictim(uint64_t *state, bool age) {
+    int victim = 0;
+    for (int j = 1; j < E; j++)
+        if (WAY_RRPV(state[j]) > WAY_RRPV(state[victim])) victim = j;
+    int delta = rrpvMax - WAY_RRPV(state[victim]);
+    for (int j = 0; age && delta && j < E; j++) state[j] += delta;
+    return victim;
+}
+
+static uint8_t *counters = NULL; // the SHCT, or Hawkeye's predictor
+
+static void countersDestroy(void) {
+    free(counters);
+    counters = NULL;
+}
+
+// SHiP-PC on top of SRRIP: a table of 3 bit counters per signature says
+// whether lines filled by it are reused.  Fills whose counter dropped to 0 are
+// inserted at the distant RRPV, the rest one step closer.
+
+#define SHIP_SIG_BITS 14
+
+static int shipInit(int S, int E_, int k_) {
+    E = E_;
+    k = k_ > 0 ? k_ : 2;
+    rrpvMax = (1 << k) - 1;
+    counters = malloc(1 << SHIP_SIG_BITS);
+    memset(counters, 1, 1 << SHIP_SIG_BITS);
+    return E;
+}
+
+static void shipHit(uint64_t *state, int set, int way, const repl_access *a) {
+    unsigned sig = WAY_SIG(state[way]);
+    if (!(state[way] & WAY_REUSED) && counters[sig] < 7) counters[sig]++;
+    state[way] = WAY(0, WAY_REUSED, sig);
+}
+
+static void shipFill(uint64_t *state, int set, int way, const repl_access *a) {
+    unsigned sig = signature(a, SHIP_SIG_BITS);
+    int rrpv = a->recent ? 0 : counters[sig] == 0 ? rrpvMax : rrpvMax - 1;
+    state[way] = WAY(rrpv, 0, sig);
+}
+
+static int shipVictim(uint64_t *state, int set) { return wayVictim(state, true); }
+
+static void shipEvict(uint64_t *state, int set, int way) {
+    unsigned sig = WAY_SIG(state[way]);
+    if (!(state[way] & WAY_REUSED) && counters[sig] > 0) counters[sig]--;
+}
+
+const repl_policy replSHiP = {"ship", shipInit, NULL, shipHit, shipFill, shipVictim, shipEvict,
+                              countersDestroy, true};
+
+// Hawkeye: OPTgen replays Belady's choices on a sample of the sets over a
+// history of 8E accesses, and trains a table of 3 bit counters per signature
+// on whether OPT would have kept the line since the signature's last access.
+// Lines of cache-friendly signatures (counter >= 4) are inserted at RRPV 0,
+// aging the other friendly lines, and cache-averse ones at the distant RRPV.
+// Averse lines go first, when a friendly line has to go its signature is
+// detrained.
+
+#define HAWKEYE_SIG_BITS 13
+#define HAWKEYE_SAMPLED_SETS 64
+
+typedef struct {
+    unsigned long line;
+    uint16_t sig;
+    uint16_t occupancy; // lines OPT holds across this access
+} optgen_entry;
+
+static optgen_entry *history = NULL; // history[sampled set * 8E + time % 8E]
+static uint64_t *historyTime = NULL; // accesses seen by each sampled set
+static int historyLength, sampleStride;
+
+static void hawkeyeDestroy(void) {
+    countersDestroy();
+    free(history);
+    free(historyTime);
+    history = NULL;
+    historyTime = NULL;
+}
+
+static int hawkeyeInit(int S, int E_, int k_) {
+    E = E_;
+    k = k_ > 0 ? k_ : 3;
+    rrpvMax = (1 << k) - 1;
+    counters = malloc(1 << HAWKEYE_SIG_BITS);
+    memset(counters, 4, 1 << HAWKEYE_SIG_BITS);
+    int sampled = S < HAWKEYE_SAMPLED_SETS ? S : HAWKEYE_SAMPLED_SETS;
+    sampleStride = S / sampled;
+    historyLength = 8 * E;
+    history = calloc((size_t)sampled * historyLength, sizeof(optgen_entry));
+    historyTime = calloc(sampled, sizeof(uint64_t));
+    return E;
+}
+
+static void train(unsigned sig, bool friendly) {
+    if (friendly && counters[sig] < 7) counters[sig]++;
+    else if (!friendly && counters[sig] > 0) counters[sig]--;
+}
+
+// OPT hits on the line's last access if the cache had room for it all the way
+// from then to now, that is every access in between has fewer than E lines
+// held across it
+static void optgen(int set, unsigned long line, unsigned sig) {
+    if (set % sampleStride) return;
+    optgen_entry *h = &history[(size_t)(set / sampleStride) * historyLength];
+    uint64_t *t = &historyTime[set / sampleStride];
+    uint64_t window = *t < (uint64_t)historyLength ? *t : (uint64_t)historyLength - 1;
+
+    for (uint64_t back = 1; back <= window; back++) {
+        optgen_entry *last = &h[(*t - back) % historyLength];
+        if (last->line != line) continue;
+        bool fits = true;
+        for (uint64_t i = 1; fits && i <= back; i++) fits = h[(*t - i) % historyLength].occupancy < E;
+        for (uint64_t i = 1; fits && i <= back; i++) h[(*t - i) % historyLength].occupancy++;
+        train(last->sig, fits);
+        break;
+    }
+    h[*t % historyLength] = (optgen_entry){.line = line, .sig = sig};
+    (*t)++;
+}
+
+static void hawkeyeHit(uint64_t *state, int set, int way, const repl_access *a) {
+    unsigned sig = signature(a, HAWKEYE_SIG_BITS);
+    optgen(set, a->line, sig);
+    state[way] = WAY(counters[sig] >= 4 ? 0 : rrpvMax, 0, sig);
+}
+
+static void hawkeyeFill(uint64_t *state, int set, int way, const repl_access *a) {
+    unsigned sig = signature(a, HAWKEYE_SIG_BITS);
+    optgen(set, a->line, sig);
+    if (counters[sig] < 4) {
+        state[way] = WAY(rrpvMax, 0, sig);
+        return;
+    }
+    for (int j = 0; j < E; j++)
+        if (j != way && WAY_RRPV(state[j]) < rrpvMax - 1) state[j]++;
+    state[way] = WAY(0, 0, sig);
+}
+
+static int hawkeyeVictim(uint64_t *state, int set) {
+    int victim = wayVictim(state, false);
+    if (WAY_RRPV(state[victim]) != rrpvMax) train(WAY_SIG(state[victim]), false);
+    return victim;
+}
+
+const repl_policy replHawkeye = {"hawkeye", hawkeyeInit, NULL, hawkeyeHit, hawkeyeFill, hawkeyeVictim, noEvict,
+                                 hawkeyeDestroy, true};
+
+const repl_policy *replPolicy(const char *name) {
+    static const repl_policy *policies[] = {&replLRU, &replPLRU, &replRRIP, &replOPT, &replSHiP, &replHawkeye};
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        if (strcmp(policies[i]->name, name) == 0) return policies[i];
+    return NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// What a replacement policy gets to see of the access being simulated
+typedef struct {
+    unsigned long line; // addr >> b
+    unsigned long pc; // 0 when the trace has no PCs
+    uint64_t nextUse; // NEXTUSE_NEVER without annotations
+    bool recent; // the line comes back from the victim cache
+} repl_access;
+
+// A replacement policy, see repl.c.  Each set owns the words of state returned
+// by init, allocated and zeroed by the cache along with its tags, and the hooks
+// get that set's words.  A policy with tables shared by every set sets shared,
+// since then the sets can not be simulated on separate threads.
+typedef struct {
+    const char *name;
+    int (*init)(int S, int E, int k); // k is -R, -1 if not given
+    void (*reset)(uint64_t *state); // prepares a set's zeroed state, may be NULL
+    void (*onHit)(uint64_t *state, int set, int way, const repl_access *a);
+    void (*onFill)(uint64_t *state, int set, int way, const repl_access *a); // way was empty or just evicted
+    int (*chooseVictim)(uint64_t *state, int set); // only called when every way is valid
+    void (*onEvict)(uint64_t *state, int set, int way);
+    void (*destroy)(void); // may be NULL
+    bool shared;
+} repl_policy;
+
+extern const repl_policy replLRU, replPLRU, replRRIP, replOPT, replSHiP, replHawkeye;
+
+const repl_policy *replPolicy(const char *name); // NULL if there is no such policy
+
+#endif
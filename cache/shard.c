@@ -0,0 +1,140 @@
+#include "shard.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Without a victim cache, sets never interact, so the sets can be split across
+// threads: set i belongs to thread i % n.  The caller hands every access to
+// shardSubmit, which appends it to the owning thread's current batch; full
+// batches are queued to that thread, which runs them in order.  Each thread
+// keeps its own counters, merged by shardFinish.  The caller answers every
+// request in a single tick, the real latencies are summed by the threads so the
+// timing can be reconstructed at the end.
+
+#define BATCH_OPS 4096
+#define MAX_QUEUED 64 // batches per thread before the producer waits
+
+// an access carries what the replacement policy sees of it, the threads share
+// nothing with the producer but the batches
+typedef struct {
+    unsigned long addr;
+    unsigned long pc;
+    uint64_t nextUse;
+    bool store;
+    bool count;
+} shard_op;
+
+typedef struct _shard_batch {
+    struct _shard_batch *next;
+    int n;
+    shard_op ops[BATCH_OPS];
+} shard_batch;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // a batch was queued, or done was set
+    pthread_cond_t space; // a batch was taken off the queue
+    shard_batch *head, *tail; // batches waiting for the thread
+    int queued;
+    bool done;
+    shard_batch *filling; // only touched by the producer
+    cache_stats stats; // only touched by the thread
+} shard;
+
+static shard *shards = NULL;
+static int shardCount = 0;
+static int setBits, blockBits;
+static shard_access accessFn = NULL;
+
+static void *shardMain(void *arg) {
+    shard *sh = arg;
+    while (1) {
+        pthread_mutex_lock(&sh->lock);
+        while (!sh->head && !sh->done) pthread_cond_wait(&sh->ready, &sh->lock);
+        shard_batch *batch = sh->head;
+        if (batch) {
+            sh->head = batch->next;
+            if (!sh->head) sh->tail = NULL;
+            sh->queued--;
+            pthread_cond_signal(&sh->space);
+        }
+        pthread_mutex_unlock(&sh->lock);
+        if (!batch) return NULL; // done, and nothing left
+
+        for (int i = 0; i < batch->n; i++) {
+            shard_op *op = &batch->ops[i];
+            accessFn(op->addr, op->store, op->pc, op->nextUse, op->count ? &sh->stats : NULL);
+        }
+        free(batch);
+    }
+}
+
+static void shardQueue(shard *sh) {
+    shard_batch *batch = sh->filling;
+    sh->filling = NULL;
+    if (!batch || batch->n == 0) {
+        free(batch);
+        return;
+    }
+    batch->next = NULL;
+    pthread_mutex_lock(&sh->lock);
+    while (sh->queued >= MAX_QUEUED) pthread_cond_wait(&sh->space, &sh->lock);
+    if (sh->tail) sh->tail->next = batch;
+    else sh->head = batch;
+    sh->tail = batch;
+    sh->queued++;
+    pthread_cond_signal(&sh->ready);
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void shardInit(int n, int s, int b, shard_access access) {
+    shardCount = n;
+    setBits = s;
+    blockBits = b;
+    accessFn = access;
+    shards = calloc(n, sizeof(shard));
+    for (int i = 0; i < n; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        pthread_cond_init(&shards[i].ready, NULL);
+        pthread_cond_init(&shards[i].space, NULL);
+        pthread_create(&shards[i].thread, NULL, shardMain, &shards[i]);
+    }
+}
+
+void shardSubmit(unsigned long addr, bool store, unsigned long pc, uint64_t nextUse, bool count) {
+    unsigned long set = (addr >> blockBits) & ((1UL << setBits) - 1);
+    shard *sh = &shards[set % shardCount];
+    if (!sh->filling) {
+        sh->filling = malloc(sizeof(shard_batch));
+        sh->filling->n = 0;
+    }
+    sh->filling->ops[sh->filling->n++] = (shard_op){.addr = addr, .pc = pc, .nextUse = nextUse, .store = store, .count = count};
+    if (sh->filling->n == BATCH_OPS) shardQueue(sh);
+}
+
+// drains and joins every thread, then adds their counters into total
+void shardFinish(cache_stats *total) {
+    if (!shards) return;
+    for (int i = 0; i < shardCount; i++) {
+        shard *sh = &shards[i];
+        shardQueue(sh);
+        pthread_mutex_lock(&sh->lock);
+        sh->done = true;
+        pthread_cond_signal(&sh->ready);
+        pthread_mutex_unlock(&sh->lock);
+    }
+    for (int i = 0; i < shardCount; i++) {
+        shard *sh = &shards[i];
+        pthread_join(sh->thread, NULL);
+        total->hits += sh->stats.hits;
+        total->misses += sh->stats.misses;
+        total->evictions += sh->stats.evictions;
+        total->latency += sh->stats.latency;
+        pthread_mutex_destroy(&sh->lock);
+        pthread_cond_destroy(&sh->ready);
+        pthread_cond_destroy(&sh->space);
+    }
+    free(shards);
+    shards = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdbool.h>
+#include "csim.h"
+
+// Set-sharded simulation, see shard.c.  access looks up one address and returns
+// its latency, st is NULL when the outcome should not be counted.
+typedef int (*shard_access)(unsigned long addr, bool store, unsigned long pc, uint64_t nextUse,
+                            cache_stats *st);
+
+void shardInit(int n, int s, int b, shard_access access);
+void shardSubmit(unsigned long addr, bool store, unsigned long pc, uint64_t nextUse, bool count);
+void shardFinish(cache_stats *total);
+
+#endif
@@ -0,0 +1,155 @@
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Mattson's stack algorithm: under LRU a set of E ways holds exactly the E most
+// recently used lines that map to it, so one LRU stack per set gives the result
+// for every associativity at once.  A reference found at depth d (1 based) hits
+// in every cache with E >= d and misses in all the others.  Stacks are cut off
+// at EHi, anything deeper misses everywhere in the range.
+//
+// OPT has the same inclusion property with a different stack order: the
+// referenced line goes on top, and the lines it pushed down are kept ordered by
+// next use, at each depth the sooner of the carried line and the resident one
+// stays and the other moves further down.
+//
+// Every set count in the range has its own stacks, using the same address
+// decomposition as cache.c: the line address is addr >> b and the set is its
+// low s bits.
+
+typedef struct {
+    unsigned long *stack; // (1 << s) stacks of EHi line addresses, MRU first
+    int *depth; // valid entries in each stack
+    unsigned long *hist; // hist[d] references found at depth d + 1
+    uint64_t *next; // OPT only, next use of each stack entry
+} sweep_level;
+
+static sweep_level *levels = NULL; // LRU levels, then the OPT ones
+static int levelCount = 0;
+static int sLo, sHi, ELo, EHi, blockBits;
+static bool sweepOpt = false;
+static unsigned long accesses = 0;
+
+void sweepInit(int sl, int sh, int El, int Eh, int b, bool opt) {
+    sLo = sl;
+    sHi = sh;
+    ELo = El;
+    EHi = Eh;
+    blockBits = b;
+    sweepOpt = opt;
+    levelCount = (sHi - sLo + 1) * (opt ? 2 : 1);
+    levels = calloc(levelCount, sizeof(sweep_level));
+    for (int i = 0; i < levelCount; i++) {
+        sweep_level *lv = &levels[i];
+        int s = sLo + i % (sHi - sLo + 1);
+        lv->stack = malloc(sizeof(unsigned long) * (1UL << s) * EHi);
+        lv->depth = calloc(1UL << s, sizeof(int));
+        lv->hist = calloc(EHi, sizeof(unsigned long));
+        if (i > sHi - sLo) lv->next = malloc(sizeof(uint64_t) * (1UL << s) * EHi);
+    }
+}
+
+// returns the depth of lineAddr in the stack, or *depth when it is not there
+static int findLine(const unsigned long *stack, int depth, unsigned long lineAddr) {
+    int d = 0;
+    while (d < depth && stack[d] != lineAddr) d++;
+    return d;
+}
+
+static void lruAccess(sweep_level *lv, int s, unsigned long lineAddr, bool count) {
+    unsigned long set = lineAddr & ((1UL << s) - 1);
+    unsigned long *stack = &lv->stack[set * EHi];
+    int *depth = &lv->depth[set];
+    int d = findLine(stack, *depth, lineAddr);
+    if (d < *depth) {
+        if (count) lv->hist[d]++;
+    } else if (*depth < EHi) {
+        (*depth)++; // not in the stack, grows it, or falls off the bottom
+    } else {
+        d = EHi - 1;
+    }
+    memmove(&stack[1], &stack[0], sizeof(unsigned long) * d);
+    stack[0] = lineAddr;
+}
+
+static void optAccess(sweep_level *lv, int s, unsigned long lineAddr, uint64_t nextUse, bool count) {
+    unsigned long set = lineAddr & ((1UL << s) - 1);
+    unsigned long *stack = &lv->stack[set * EHi];
+    uint64_t *next = &lv->next[set * EHi];
+    int *depth = &lv->depth[set];
+    int d = findLine(stack, *depth, lineAddr);
+    if (d < *depth && count) lv->hist[d]++;
+
+    unsigned long carry = lineAddr;
+    uint64_t carryNext = nextUse;
+    int end = d < *depth ? d : *depth; // last depth the carried line can land on
+    for (int i = 0; i < end; i++) {
+        if (i > 0 && next[i] <= carryNext) continue; // resident is needed sooner
+        unsigned long line = stack[i];
+        uint64_t lineNext = next[i];
+        stack[i] = carry;
+        next[i] = carryNext;
+        carry = line;
+        carryNext = lineNext;
+    }
+    if (d < *depth || *depth < EHi) { // else the carried line falls off the bottom
+        if (d == *depth) (*depth)++;
+        stack[end] = carry;
+        next[end] = carryNext;
+    }
+}
+
+// count is false during functional warmup, the stacks are still updated
+void sweepAccess(unsigned long addr, uint64_t nextUse, bool count) {
+    unsigned long lineAddr = addr >> blockBits;
+    if (count) accesses++;
+    for (int s = sLo; s <= sHi; s++) {
+        lruAccess(&levels[s - sLo], s, lineAddr, count);
+        if (sweepOpt) optAccess(&levels[sHi - sLo + 1 + s - sLo], s, lineAddr, nextUse, count);
+    }
+}
+
+// prints one row per set count, one column per associativity
+static void reportTable(int outFd, const char *name, sweep_level *table) {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "%s misses (%lu accesses, B = %d)\n  s\\E", name, accesses, 1 << blockBits);
+    (void)!write(outFd, buf, n);
+    for (int E = ELo; E <= EHi; E++) {
+        n = snprintf(buf, sizeof(buf), " %10d", E);
+        (void)!write(outFd, buf, n);
+    }
+    (void)!write(outFd, "\n", 1);
+
+    for (int s = sLo; s <= sHi; s++) {
+        sweep_level *lv = &table[s - sLo];
+        unsigned long hits = 0;
+        n = snprintf(buf, sizeof(buf), "%5d", s);
+        (void)!write(outFd, buf, n);
+        for (int d = 0; d < ELo - 1; d++) hits += lv->hist[d];
+        for (int E = ELo; E <= EHi; E++) {
+            hits += lv->hist[E - 1];
+            n = snprintf(buf, sizeof(buf), " %10lu", accesses - hits);
+            (void)!write(outFd, buf, n);
+        }
+        (void)!write(outFd, "\n", 1);
+    }
+}
+
+void sweepReport(int outFd) {
+    reportTable(outFd, "LRU", levels);
+    if (sweepOpt) reportTable(outFd, "OPT", &levels[sHi - sLo + 1]);
+}
+
+void sweepDestroy(void) {
+    if (!levels) return;
+    for (int i = 0; i < levelCount; i++) {
+        free(levels[i].stack);
+        free(levels[i].depth);
+        free(levels[i].hist);
+        free(levels[i].next);
+    }
+    free(levels);
+    levels = NULL;
+}
@@ -0,0 +1,15 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Single pass evaluation of every geometry with sLo <= s <= sHi and
+// ELo <= E <= EHi for a fixed block size, see sweep.c.  With opt, OPT is
+// evaluated as well, from the next use passed with each access.
+void sweepInit(int sLo, int sHi, int ELo, int EHi, int b, bool opt);
+void sweepAccess(unsigned long addr, uint64_t nextUse, bool count);
+void sweepReport(int outFd);
+void sweepDestroy(void);
+
+#endif
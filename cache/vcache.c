@@ -0,0 +1,107 @@
+#include "vcache.h"
+#include <stdlib.h>
+
+// The entries live in one array and are linked in LRU order, MRU first, with
+// the free entries on a list of their own.  An open-addressed table (linear
+// probing, at most half full) maps a line address to its entry, and deletes
+// shift the following run back instead of leaving tombstones.  Everything is
+// allocated up front, so an access never touches the heap.
+
+typedef struct {
+    unsigned long line;
+    bool dirty;
+    int prev, next; // LRU order, or next free, -1 at the ends
+} entry;
+
+static entry *entries = NULL;
+static int *table = NULL; // entry + 1, 0 when the slot is empty
+static unsigned long mask = 0;
+static int head = -1, tail = -1, freeList = -1;
+
+static inline unsigned long slotOf(unsigned long line) { return (line * 0x9E3779B97F4A7C15UL >> 32) & mask; }
+
+void vcacheInit(int n) {
+    unsigned long size = 4;
+    while (size < 2UL * n) size <<= 1;
+    mask = size - 1;
+    entries = malloc(sizeof(entry) * n);
+    table = calloc(size, sizeof(int));
+    for (int i = 0; i < n; i++) entries[i].next = i + 1 < n ? i + 1 : -1;
+    freeList = n > 0 ? 0 : -1;
+    head = tail = -1;
+}
+
+// the table slot holding line, or the empty slot where it would go
+static unsigned long probe(unsigned long line) {
+    unsigned long i = slotOf(line);
+    while (table[i] && entries[table[i] - 1].line != line) i = (i + 1) & mask;
+    return i;
+}
+
+bool vcacheHas(unsigned long lineAddr) { return table[probe(lineAddr)] != 0; }
+
+static void listUnlink(int e) {
+    if (entries[e].prev != -1) entries[entries[e].prev].next = entries[e].next;
+    else head = entries[e].next;
+    if (entries[e].next != -1) entries[entries[e].next].prev = entries[e].prev;
+    else tail = entries[e].prev;
+}
+
+// empties slot i, moving back the entries after it that probed past it
+static void tableDelete(unsigned long i) {
+    unsigned long j = i;
+    table[i] = 0;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!table[j]) return;
+        unsigned long home = slotOf(entries[table[j] - 1].line);
+        // j's entry may move to i only if its home is not in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table[i] = table[j];
+            table[j] = 0;
+            i = j;
+        }
+    }
+}
+
+static void removeEntry(unsigned long slot) {
+    int e = table[slot] - 1;
+    tableDelete(slot);
+    listUnlink(e);
+    entries[e].next = freeList;
+    freeList = e;
+}
+
+bool vcacheTake(unsigned long lineAddr, bool *dirty) {
+    unsigned long slot = probe(lineAddr);
+    if (!table[slot]) return false;
+    *dirty = entries[table[slot] - 1].dirty;
+    removeEntry(slot);
+    return true;
+}
+
+bool vcacheInsert(unsigned long lineAddr, bool dirty, bool *evictedDirty) {
+    bool evicted = false;
+    if (freeList == -1) {
+        if (tail == -1) return false; // no entries at all
+        *evictedDirty = entries[tail].dirty;
+        removeEntry(probe(entries[tail].line));
+        evicted = true;
+    }
+
+    int e = freeList;
+    freeList = entries[e].next;
+    entries[e] = (entry){.line = lineAddr, .dirty = dirty, .prev = -1, .next = head};
+    if (head != -1) entries[head].prev = e;
+    else tail = e;
+    head = e;
+    table[probe(lineAddr)] = e + 1;
+    return evicted;
+}
+
+void vcacheDestroy(void) {
+    free(entries);
+    free(table);
+    entries = NULL;
+    table = NULL;
+}
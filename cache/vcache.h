@@ -0,0 +1,20 @@
+#ifndef VCACHE_H
+#define VCACHE_H
+
+#include <stdbool.h>
+
+// The victim cache, see vcache.c.  It holds line addresses (addr >> b) of lines
+// evicted from the main cache, fully associative with LRU replacement.
+void vcacheInit(int n);
+bool vcacheHas(unsigned long lineAddr);
+
+// removes lineAddr if present, *dirty says whether it was dirty
+bool vcacheTake(unsigned long lineAddr, bool *dirty);
+
+// adds a line, returns true if the LRU line had to go to make room for it,
+// *evictedDirty says whether that line was dirty
+bool vcacheInsert(unsigned long lineAddr, bool dirty, bool *evictedDirty);
+
+void vcacheDestroy(void);
+
+#endif
@@ -8,7 +8,7 @@ extern interconn* inter_sim;
 
 typedef enum _coherence_states
 {
-    UNDEF = 0, // As tree find returns NULL, we need an unused for NULL
+    UNDEF = 0, // never a real state, the state table stores INVALID as 0
     MODIFIED,
     INVALID,
     INVALID_MODIFIED,
@@ -20,6 +20,7 @@ typedef enum _coherence_states
     OWNED_MODIFIED
 } coherence_states;
 
+// In the order of protocols.spec
 typedef enum _coherence_scheme
 {
     MI,
@@ -29,35 +30,38 @@ typedef enum _coherence_scheme
     MESIF
 } coherence_scheme;
 
+// One entry of the tables generated from protocols.spec
+typedef struct _protocol_entry {
+    uint8_t next;    // coherence_states
+    uint8_t actions; // PROTO_*
+} protocol_entry;
+
+#define STATE_COUNT (OWNED_MODIFIED + 1)
+#define PROTOCOL_COUNT (MESIF + 1)
+#define SNOOP_EVENTS (WRITEBACK + 1)
+
+// The cache action is kept in bits 5-6 so it can be read out without a branch
+#define PROTO_CA_SHIFT 5
+#define PROTO_PERM 0x01
+#define PROTO_BUSRD 0x02
+#define PROTO_BUSWR 0x04
+#define PROTO_SHARED 0x08
+#define PROTO_DATA 0x10
+#define PROTO_RECV (DATA_RECV << PROTO_CA_SHIFT)
+#define PROTO_INVAL (INVALIDATE << PROTO_CA_SHIFT)
+#define PROTO_ERROR 0x80
+
 coherence_states
-cacheMI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-cacheMSI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMSI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-cacheMESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-cacheMOESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMOESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-cacheMESIF(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
+protocolCache(coherence_scheme scheme, uint8_t is_read, uint8_t* permAvail,
+              coherence_states currentState, uint64_t addr, int procNum);
 coherence_states
-snoopMESIF(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum);
+protocolSnoop(coherence_scheme scheme, bus_req_type reqType, cache_action* ca,
+              coherence_states currentState, uint64_t addr, int procNum);
+
+// A dirty line leaving the cache, counted with the protocol's messages
+void sendWriteback(uint64_t addr, int procNum);
+
+// The transition and message counts, see protocol.c
+void protocolReport(coherence_scheme scheme, int outFd);
 
 #endif
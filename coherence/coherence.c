@@ -7,21 +7,44 @@
 #include <stdio.h>
 #include "coher_internal.h"
 
-#include "stree.h"
+#include "sharing.h"
+#include "statetable.h"
+
+#ifdef DIRECTORY
+#include "directory.h"
+#define COHER_OPTS "s:p:f:"
+#else
+#define COHER_OPTS "s:f:"
+#endif
 
 typedef void (*cacheCallbackFunc)(int, int, int64_t);
 
-tree_t** coherStates = NULL;
 int processorCount = 1;
+int CADSS_FUNCTIONAL = 0;
 bool verbose = false;
 coherence_scheme cs = MI;
 coher* self = NULL;
 interconn* inter_sim = NULL;
 cacheCallbackFunc cacheCallback = NULL;
+bool profileSharing = false;
+
+// Lines a cache gave up while a transition was in flight, dropped once the
+// transition is done.  Few are pending at a time, so a list will do.
+typedef struct _pending_drop {
+    uint64_t addr;
+    int processorNum;
+} pending_drop;
+
+pending_drop* drops = NULL;
+int dropCount = 0;
+int dropSize = 0;
 
 uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum);
 uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum);
 uint8_t invlReq(uint64_t addr, int processorNum);
+uint8_t recallReq(uint64_t addr, int processorNum);
+void noteAccess(uint8_t is_read, uint64_t memAddress, int size, int blockSize,
+                int processorNum);
 void registerCacheInterface(void (*callback)(int, int, int64_t));
 
 void printv(const char *format, ...) { // wrapper for printf, only prints when verbose is set to true
@@ -33,18 +56,42 @@ void printv(const char *format, ...) { // wrapper for printf, only prints when v
 coher* init(coher_sim_args* csa)
 {
     int op;
+    int pointers = 0;
+    int profileBits = 0;
 
-    while ((op = getopt(csa->arg_count, csa->arg_list, "s:")) != -1)
+    while ((op = getopt(csa->arg_count, csa->arg_list, COHER_OPTS)) != -1)
     {
         switch (op)
         {
             case 's':
                 cs = atoi(optarg);
                 break;
+
+            // directory pointers per line, 0 for a full bit vector
+            case 'p':
+                pointers = atoi(optarg);
+                break;
+
+            // sharing profile with 4 << n lines
+            case 'f':
+                profileBits = atoi(optarg);
+                break;
         }
     }
 
-    if (processorCount < 1 || processorCount > 256)
+    if ((unsigned)cs >= PROTOCOL_COUNT)
+    {
+        fprintf(stderr, "Error: undefined coherence scheme - %d\n", cs);
+        return NULL;
+    }
+
+    if (pointers < 0)
+    {
+        fprintf(stderr, "Error: invalid directory pointers - %d\n", pointers);
+        return NULL;
+    }
+
+    if (processorCount < 1 || processorCount > CADSS_MAX_PROCESSORS)
     {
         fprintf(stderr,
                 "Error: processorCount outside valid range - %d specified\n",
@@ -52,11 +99,13 @@ coher* init(coher_sim_args* csa)
         return NULL;
     }
 
-    // for each processor, maintain a tree map which maps address -> state for fast lookup
-    coherStates = malloc(sizeof(tree_t*) * processorCount);
-    for (int i = 0; i < processorCount; i++)
+    // one table maps address -> the state of every processor
+    stateTableInit(processorCount);
+
+    if (profileBits > 0)
     {
-        coherStates[i] = tree_new();
+        profileSharing = true;
+        sharingInit(profileBits);
     }
 
     inter_sim = csa->inter;
@@ -68,9 +117,14 @@ coher* init(coher_sim_args* csa)
     self->permReq = permReq;
     self->busReq = busReq;
     self->invlReq = invlReq;
+    self->recallReq = recallReq;
+    self->noteAccess = noteAccess;
     self->registerCacheInterface = registerCacheInterface;
 
     inter_sim->registerCoher(self);
+#ifdef DIRECTORY
+    directoryInit(inter_sim, pointers);
+#endif
 
     return self;
 }
@@ -80,19 +134,62 @@ void registerCacheInterface(void (*callback)(int, int, int64_t))
     cacheCallback = callback;
 }
 
-coherence_states getState(uint64_t addr, int processorNum) // given a memory address, looks up what state it's in
+static int findDrop(uint64_t addr, int processorNum)
+{
+    for (int i = 0; i < dropCount; i++)
+    {
+        if (drops[i].addr == addr && drops[i].processorNum == processorNum)
+            return i;
+    }
+    return -1;
+}
+
+static void addDrop(uint64_t addr, int processorNum)
+{
+    if (findDrop(addr, processorNum) != -1)
+        return;
+    if (dropCount == dropSize)
+    {
+        dropSize = dropSize ? 2 * dropSize : 16;
+        drops = realloc(drops, sizeof(pending_drop) * dropSize);
+    }
+    drops[dropCount++] = (pending_drop){addr, processorNum};
+}
+
+// Removes the pending drop of addr by processorNum, returns whether there
+// was one
+static bool takeDrop(uint64_t addr, int processorNum)
+{
+    int i = findDrop(addr, processorNum);
+    if (i == -1)
+        return false;
+    drops[i] = drops[--dropCount];
+    return true;
+}
+
+static bool isStable(coherence_states state)
 {
-    coherence_states lookState
-        = (coherence_states)tree_find(coherStates[processorNum], addr);
-    if (lookState == UNDEF)
-        return INVALID;
+    switch (state)
+    {
+        case MODIFIED:
+        case INVALID:
+        case SHARING:
+        case EXCLUSIVE_CLEAN:
+        case OWNED:
+            return true;
+        default:
+            return false;
+    }
+}
 
-    return lookState;
+coherence_states getState(uint64_t addr, int processorNum) // given a memory address, looks up what state it's in
+{
+    return stateGet(addr, processorNum);
 }
 
 void setState(uint64_t addr, int processorNum, coherence_states nextState) // given a memory address, set its state
 {
-    tree_insert(coherStates[processorNum], addr, (void*)nextState);
+    stateSet(addr, processorNum, nextState);
 }
 
 uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum) // basically encapsulates receiving BusRd, BusWr, or another type of bus request
@@ -107,31 +204,12 @@ uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum) // basical
     coherence_states nextState;
     cache_action ca;
 
-    switch (cs) // THIS SWITCH STATEMENT IS TRIGGERED WHEN THERE IS A BUS REQUEST
+    nextState = protocolSnoop(cs, reqType, &ca, currentState, addr,
+                              processorNum);
+
+    if (profileSharing && ca == INVALIDATE && reqType == BUSWR)
     {
-        case MI:
-            nextState
-                = snoopMI(reqType, &ca, currentState, addr, processorNum); // only moves M to I on BusWr
-            break;
-        case MSI:
-            nextState
-                = snoopMSI(reqType, &ca, currentState, addr, processorNum);
-            break;
-        case MESI:
-            nextState
-                = snoopMESI(reqType, &ca, currentState, addr, processorNum);
-            break;
-        case MOESI:
-            nextState
-                = snoopMOESI(reqType, &ca, currentState, addr, processorNum);
-            break;
-        case MESIF:
-            nextState
-                = snoopMESIF(reqType, &ca, currentState, addr, processorNum);
-            break;
-        default:
-            fprintf(stderr, "Undefined coherence scheme - %d\n", cs);
-            break;
+        sharingInvalidate(addr, processorNum);
     }
 
     switch (ca)
@@ -146,21 +224,82 @@ uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum) // basical
             assert(0);
     }
 
-    // If the destination state is invalid, that is an implicit
-    // state and does not need to be stored in the tree.
-    if (nextState == INVALID)
+    // INVALID is implicit, setState drops the line instead of storing it
+    if (nextState != currentState)
     {
-        if (currentState != INVALID)
+        setState(addr, processorNum, nextState);
+    }
+
+    // The cache gave the line up during the transition that just finished
+    if (dropCount > 0 && isStable(nextState) && !isStable(currentState)
+        && takeDrop(addr, processorNum))
+    {
+        invlReq(addr, processorNum);
+    }
+
+    return 0;
+}
+
+// Functional warmup: the other processors' states are updated directly to what
+// the bus transactions would leave behind, and the permissions are always granted
+uint8_t permReqFunctional(uint8_t is_read, uint64_t addr, int processorNum)
+{
+    coherence_states currentState = getState(addr, processorNum);
+    bool othersShare = false;
+
+    if (currentState == MODIFIED) return 1;
+    if (is_read && currentState != INVALID) return 1; // S, E, O and F can all be read
+    if (!is_read && currentState == EXCLUSIVE_CLEAN)
+    {
+        setState(addr, processorNum, MODIFIED);
+        return 1;
+    }
+
+    for (int i = 0; i < processorCount; i++)
+    {
+        if (i == processorNum) continue;
+
+        coherence_states otherState = getState(addr, i);
+        if (otherState == INVALID) continue;
+
+        if (!is_read || cs == MI) // BusWr snoop, every other copy is invalidated
         {
-            tree_remove(coherStates[processorNum], addr);
+            setState(addr, i, INVALID);
+            cacheCallback(INVALIDATE, i, addr);
+            if (profileSharing) sharingInvalidate(addr, i);
+            continue;
+        }
+
+        othersShare = true;
+        switch (otherState) // BusRd snoop, owners give up exclusivity
+        {
+            case MODIFIED:
+                setState(addr, i, (cs == MOESI) ? OWNED : SHARING);
+                break;
+            case EXCLUSIVE_CLEAN:
+                setState(addr, i, SHARING);
+                break;
+            case OWNED:
+                if (cs == MESIF) setState(addr, i, SHARING); // F moves to the new reader
+                break;
+            default:
+                break;
         }
     }
-    else
+
+    // The interconnect still learns who holds what, for its snoop filter
+    inter_sim->busReq(is_read ? BUSRD : BUSWR, addr, processorNum);
+
+    coherence_states nextState = MODIFIED;
+    if (is_read && cs != MI)
     {
-        setState(addr, processorNum, nextState);
+        if (cs == MSI) nextState = SHARING;
+        else if (!othersShare) nextState = EXCLUSIVE_CLEAN;
+        else nextState = (cs == MESIF) ? OWNED : SHARING;
     }
 
-    return 0;
+    setState(addr, processorNum, nextState);
+    return 1;
 }
 
 uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum) // basically encapsulates PrRd and PrWr
@@ -171,104 +310,123 @@ uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum) // basically e
         // ERROR
     }
 
+    // The cache wants back a line it gave up before its transition finished
+    if (dropCount > 0)
+    {
+        takeDrop(addr, processorNum);
+    }
+
+    if (CADSS_FUNCTIONAL)
+    {
+        return permReqFunctional(is_read, addr, processorNum);
+    }
+
     coherence_states currentState = getState(addr, processorNum);
     coherence_states nextState;
     uint8_t permAvail = 0; // return value bool: whether permissions were granted or not
 
-    switch (cs)
+    nextState = protocolCache(cs, is_read, &permAvail, currentState, addr,
+                              processorNum);
+
+    setState(addr, processorNum, nextState);
+    return permAvail;
+}
+
+void noteAccess(uint8_t is_read, uint64_t memAddress, int size, int blockSize,
+                int processorNum)
+{
+    if (profileSharing)
     {
-        case MI:
-            nextState = cacheMI(is_read, &permAvail, currentState, addr,
-                                processorNum);
-            break;
+        sharingAccess(is_read, memAddress, size, blockSize, processorNum);
+    }
+}
 
-        case MSI:
-            nextState = cacheMSI(is_read, &permAvail, currentState, addr, 
-                                processorNum);
-            break;
+//
+// invlReq
+//
+//   The cache gave up addr.  Stable states drop to INVALID, and the states
+//   that hold the only up-to-date copy (M, and O in MOESI) write it back over
+//   the interconnect first.  Returns whether data was written back.  A line
+//   with a transition in flight keeps its state until the transition is
+//   done, and is dropped then.
+//
+uint8_t invlReq(uint64_t addr, int processorNum)
+{
+    printv("In mode %d; invalidation request with address %lx, processor %d\n", cs, addr, processorNum);
+    if (processorNum < 0 || processorNum >= processorCount)
+    {
+        return 0;
+    }
 
-        case MESI:
-            nextState = cacheMESI(is_read, &permAvail, currentState, addr, 
-                                processorNum);
-            break;
+    coherence_states currentState = getState(addr, processorNum);
+    uint8_t flush = 0;
 
-        case MOESI:
-            nextState = cacheMOESI(is_read, &permAvail, currentState, addr, 
-                                processorNum);
+    switch (currentState)
+    {
+        case MODIFIED:
+            flush = 1;
             break;
-
-        case MESIF:
-            nextState = cacheMESIF(is_read, &permAvail, currentState, addr, 
-                                processorNum);
+        case OWNED: // F in MESIF is a clean copy
+            flush = (cs == MOESI);
             break;
-
-        default:
-            fprintf(stderr, "Undefined coherence scheme - %d\n", cs);
+        case SHARING:
+        case EXCLUSIVE_CLEAN:
             break;
+        case INVALID:
+            return 0;
+        default:
+            addDrop(addr, processorNum);
+            return 0;
     }
 
-    setState(addr, processorNum, nextState);
-    return permAvail;
+    if (flush && !CADSS_FUNCTIONAL)
+    {
+        sendWriteback(addr, processorNum);
+    }
+    setState(addr, processorNum, INVALID);
+
+    return flush;
 }
 
-uint8_t invlReq(uint64_t addr, int processorNum) // basically handles cache line invalidation
+//
+// recallReq
+//
+//   The interconnect takes addr back from processorNum.  Stable states go
+//   through invlReq, and an upgrade in flight (SM, or OM in MOESI and F to M
+//   in MESIF) gives up its copy and waits for the data like IM.  IS and IM
+//   hold nothing yet.  Either way the cache is told to drop the line.
+//   Returns whether data was written back.
+//
+uint8_t recallReq(uint64_t addr, int processorNum)
 {
-    // printv("In mode %d; invalidation request with address %lx, processor %d\n", cs, addr, processorNum);
-    // coherence_states currentState, nextState = INVALID;
-    // cache_action ca;
-    // uint8_t flush;
-
-    // if (processorNum < 0 || processorNum >= processorCount)
-    // {
-    //     // ERROR
-    // }
-
-    // currentState = getState(addr, processorNum);
-
-    // flush = 0; // returns whether or not data was actually flushed or not
-    // switch (cs)
-    // {
-    //     case MI:
-    //         nextState = INVALID;
-    //         if (currentState != INVALID)
-    //         {
-    //             inter_sim->busReq(DATA, addr, processorNum); // DATA bus req type denotes that a processor flushed this cache entry
-    //             flush = 1;
-    //         }
-    //         break;
-    //     case MSI:
-    //         nextState = INVALID;
-    //         if (currentState == MODIFIED) {
-    //             inter_sim->busReq(DATA, addr, processorNum);
-    //             flush = 1; // not sure about this logic yet
-    //         } break;
-    //     case MESI:
-    //         nextState = INVALID;
-    //         if (currentState == MODIFIED) {
-    //             inter_sim->busReq(DATA, addr, processorNum);
-    //             flush = 1; // not sure about this logic yet
-    //         } break;
-    //     case MOESI:
-    //         nextState = INVALID;
-    //         if (currentState == MODIFIED || currentState == OWNED) {
-    //             inter_sim->busReq(DATA, addr, processorNum);
-    //             flush = 1;
-    //         } break;
-    //     case MESIF:
-    //         nextState = INVALID;
-    //         if (currentState == MODIFIED) {
-    //             inter_sim->busReq(DATA, addr, processorNum);
-    //             flush = 1; 
-    //         } break;
-    //     default:
-    //         fprintf(stderr, "Undefined coherence scheme - %d\n", cs);
-    //         break;
-    // }
-
-    // tree_remove(coherStates[processorNum], addr);
-
-    // // Notify about "permReqOnFlush".
-    // return flush;
+    printv("In mode %d; recall request with address %lx, processor %d\n", cs, addr, processorNum);
+    coherence_states currentState = getState(addr, processorNum);
+    uint8_t flush = 0;
+
+    switch (currentState)
+    {
+        case INVALID:
+        case INVALID_SHARING:
+        case INVALID_MODIFIED:
+            return 0;
+        case SHARING_MODIFIED:
+            setState(addr, processorNum, INVALID_MODIFIED);
+            break;
+        case OWNED_MODIFIED:
+            flush = (cs == MOESI);
+            if (flush && !CADSS_FUNCTIONAL)
+            {
+                sendWriteback(addr, processorNum);
+            }
+            setState(addr, processorNum, INVALID_MODIFIED);
+            break;
+        default:
+            flush = invlReq(addr, processorNum);
+            break;
+    }
+
+    cacheCallback(INVALIDATE, processorNum, addr);
+    return flush;
 }
 
 int tick()
@@ -278,12 +436,25 @@ int tick()
 
 int finish(int outFd)
 {
+#ifdef DIRECTORY
+    directoryFinish(outFd);
+#endif
+    protocolReport(cs, outFd);
+    if (profileSharing)
+    {
+        sharingReport(outFd);
+    }
     return inter_sim->si.finish(outFd);
 }
 
 int destroy(void)
 {
-    // TODO
+    stateTableDestroy();
+    sharingDestroy();
+    free(drops);
+#ifdef DIRECTORY
+    directoryDestroy();
+#endif
 
     return inter_sim->si.destroy();
 }
@@ -1,521 +1,150 @@
 #include "coher_internal.h"
+#include "protocol_tables.h"
+#include <unistd.h>
+
+//
+// The protocols themselves are in protocols.spec; protogen turns them into
+//   the [state][event] tables included above.  A request is one lookup,
+//   which gives the next state, whether the access may proceed, what to put
+//   on the bus and what the cache has to do.
+//
+// Every transition, every message put on the bus and every fill is counted,
+//   and protocolReport prints the counts at finish.  Events are numbered
+//   is_read for the processor's requests, then CACHE_EVENTS + bus_req_type.
+//
+
+#define CACHE_EVENTS 2
+#define EVENTS (CACHE_EVENTS + SNOOP_EVENTS)
+
+static uint64_t transitions[STATE_COUNT][EVENTS][STATE_COUNT];
+static uint64_t messages[SNOOP_EVENTS];
+static uint64_t cacheFills = 0;
+static uint64_t memoryFills = 0;
+
+static const char* schemeNames[PROTOCOL_COUNT]
+    = {"MI", "MSI", "MESI", "MOESI", "MESIF"};
+static const char* stateNames[STATE_COUNT]
+    = {"-", "M", "I", "IM", "S", "IS", "SM", "E", "O", "OM"};
+static const char* eventNames[EVENTS]
+    = {"PrWr",  "PrRd",   "NoReq",  "BusRd",    "BusWr",
+       "Data", "Shared", "Memory", "Writeback"};
+
+// MESIF keeps its forwarder in O
+static const char* stateName(coherence_scheme scheme, int state)
+{
+    return (scheme == MESIF && state == OWNED) ? "F" : stateNames[state];
+}
 
 void sendBusRd(uint64_t addr, int procNum)
 {
+    messages[BUSRD]++;
     inter_sim->busReq(BUSRD, addr, procNum);
 }
 
 void sendBusWr(uint64_t addr, int procNum)
 {
+    messages[BUSWR]++;
     inter_sim->busReq(BUSWR, addr, procNum);
 }
 
 void sendData(uint64_t addr, int procNum)
 {
+    messages[DATA]++;
     inter_sim->busReq(DATA, addr, procNum);
 }
 
 void indicateShared(uint64_t addr, int procNum)
 {
+    messages[SHARED]++;
     inter_sim->busReq(SHARED, addr, procNum);
 }
 
-coherence_states
-cacheMI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
+void sendWriteback(uint64_t addr, int procNum)
 {
-    switch (currentState)
-    {
-        case INVALID: // need to gain exclusive permission (in MI, this occurs on both PrRd and PrWr)
-            *permAvail = 0; // set permission available to false
-            sendBusWr(addr, procNum); // send BusWr to all other processors (since no differentiation between PrRd and PrWr)
-            return INVALID_MODIFIED; // move to intermediate state waiting for permissions
-        case MODIFIED:
-            *permAvail = 1; // permissions already available
-            return MODIFIED;
-        case INVALID_MODIFIED: // intermediate state: need to wait for permissions
-            fprintf(stderr, "IM state on %lx, but request %d\n", addr,
-                    is_read);
-            *permAvail = 0; // do nothing; snoopMI will snoop for other processors granting permission and move us to M state
-            return INVALID_MODIFIED;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
+    messages[WRITEBACK]++;
+    inter_sim->busReq(WRITEBACK, addr, procNum);
 }
 
-coherence_states
-snoopMI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum)
+static void runActions(uint8_t actions, coherence_states currentState,
+                       int event, uint64_t addr, int procNum)
 {
-    *ca = NO_ACTION;
-    switch (currentState)
-    {
-        case INVALID:
-            return INVALID;
-        case MODIFIED: // note that this triggers on all req types, because M is always exclusive on both Rd and Wr
-            sendData(addr, procNum); // send DATA bus request to other processors (indicating line was flushed)
-            // indicateShared(addr, procNum); // Needed for E state
-            *ca = INVALIDATE;
-            // printf("Setting cache action to INVALIDATE\n");
-            return INVALID;
-        case INVALID_MODIFIED:
-            if (reqType == DATA) // only need to wait for one response, since only one processor in M at a time
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-
-            return INVALID_MODIFIED;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
+    if (actions & PROTO_BUSRD)
+        sendBusRd(addr, procNum);
+    if (actions & PROTO_BUSWR)
+        sendBusWr(addr, procNum);
+    if (actions & PROTO_SHARED)
+        indicateShared(addr, procNum);
+    if (actions & PROTO_DATA)
+        sendData(addr, procNum);
+    if (actions & PROTO_ERROR)
+        fprintf(stderr, "State %d not supported on event %d, found on %lx\n",
+                currentState, event, addr);
 }
 
 coherence_states
-cacheMSI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
+protocolCache(coherence_scheme scheme, uint8_t is_read, uint8_t* permAvail,
+              coherence_states currentState, uint64_t addr, int procNum)
 {
-    switch(currentState) {
-        case INVALID:
-            *permAvail = 0; // indicate permissions not available yet, need to go to intermediate state first
-            if (is_read) {
-                sendBusRd(addr, procNum);
-                return INVALID_SHARING;
-            } else {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1; // permissions already available
-            return MODIFIED;
-        case INVALID_MODIFIED:
-            *permAvail = 0; // do nothing; snoopMI will move this state to modified eventually when DATA is received
-            return INVALID_MODIFIED;
-        case SHARING:
-            if (is_read) {
-                *permAvail = 1; // if we are reading, the permissions already available
-                return SHARING;
-            } else {
-                *permAvail = 0;
-                sendBusWr(addr, procNum); // same actions as moving from I -> M
-                return SHARING_MODIFIED;
-            }
-        case INVALID_SHARING:
-            *permAvail = 0; // do nothing; snoopMI will handle this case as well
-            return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            *permAvail = 0;
-            return SHARING_MODIFIED;
-        default:
-            break;
-    } return INVALID;
-}
+    protocol_entry e = cacheTable[scheme][currentState][is_read != 0];
 
-coherence_states
-snoopMSI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState) {
-        case INVALID:
-            return INVALID;
-        case MODIFIED:
-            sendData(addr, procNum); // broadcast DATA busreq to let processors know data was evicted
-            if (reqType == BUSRD) return SHARING; // move M -> S if BusRd, else move M -> I (how do we flush here???)
-            else if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_MODIFIED:
-            if (reqType == DATA) {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } return INVALID_MODIFIED;
-        case SHARING:
-            if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } return SHARING;
-        case INVALID_SHARING:
-            if (reqType == DATA) { // same logic as INVALID_MODIFIED
-                *ca = DATA_RECV;
-                return SHARING;
-            } return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            if (reqType == DATA) { // also same logic as INVALID_MODIFIED
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } return SHARING_MODIFIED;
-        default:
-            break;
-    } return INVALID;
-}
+    if (e.actions & ~PROTO_PERM)
+        runActions(e.actions, currentState, is_read, addr, procNum);
 
-coherence_states
-cacheMESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch(currentState) {
-        case INVALID:
-            *permAvail = 0; // indicate permissions not available yet, need to go to intermediate state first
-            if (is_read) {
-                sendBusRd(addr, procNum); // send BusRd, wait and see if anyone asserts SHARED
-                return INVALID_SHARING; // intermediate between I -> S and I -> E
-            } else {
-                sendBusWr(addr, procNum); 
-                return INVALID_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1; // permissions already available
-            return MODIFIED;
-        case INVALID_MODIFIED:
-            *permAvail = 0; // do nothing; snoopMI will move this state to modified eventually when DATA is received
-            return INVALID_MODIFIED;
-        case SHARING:
-            if (is_read) {
-                *permAvail = 1; // if we are reading, then permissions already available
-                return SHARING;
-            } else {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARING_MODIFIED;
-            }
-        case INVALID_SHARING:
-            *permAvail = 0; // do nothing; snoopMI will handle this case as well
-            return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            *permAvail = 0;
-            return SHARING_MODIFIED;
-        case EXCLUSIVE_CLEAN:
-            *permAvail = 1; // in E state, we already have RW permissions
-            return is_read ? EXCLUSIVE_CLEAN : MODIFIED;
-        default:
-            break;
-    } return INVALID;
+    transitions[currentState][is_read != 0][e.next]++;
+    *permAvail = e.actions & PROTO_PERM;
+    return e.next;
 }
 
 coherence_states
-snoopMESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum)
+protocolSnoop(coherence_scheme scheme, bus_req_type reqType, cache_action* ca,
+              coherence_states currentState, uint64_t addr, int procNum)
 {
-    *ca = NO_ACTION;
-    switch (currentState) {
-        case INVALID:
-            return INVALID;
-        case MODIFIED:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // IMPORTANT: since we are moving to S, need to indicate shared
-                sendData(addr, procNum); 
-                return SHARING; // move M -> S if BusRd, else move M -> I
-            } else if (reqType == BUSWR) {
-                sendData(addr, procNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } return INVALID_MODIFIED;
-        case SHARING:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // indicate shared if another processor attempts to read (determines E state or not)
-                return SHARING;
-            } else if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_SHARING:
-            if (reqType == SHARED) {
-                *ca = DATA_RECV;
-                return SHARING;
-            } else if (reqType == DATA) {
-                *ca = DATA_RECV;
-                return EXCLUSIVE_CLEAN; // move to E state if we receive DATA without receiving SHARED
-            } return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) { // same as IM state, but asserts shared if we receive a BusRd
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } else if (reqType == BUSRD) indicateShared(addr, procNum);
-            return SHARING_MODIFIED;
-        case EXCLUSIVE_CLEAN:
-            if (reqType == BUSWR) { // rest is same logic as SHARING state
-                *ca = INVALIDATE;
-                return INVALID;
-            } else if (reqType == BUSRD) {
-                indicateShared(addr, procNum);
-                return SHARING;
-            } break;
-        default:
-            break;
-    } return INVALID;
-}
+    protocol_entry e = snoopTable[scheme][currentState][reqType];
 
-coherence_states
-cacheMOESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch(currentState) {
-        case INVALID:
-            *permAvail = 0; // indicate permissions not available yet, need to go to intermediate state first
-            if (is_read) {
-                sendBusRd(addr, procNum); // send BusRd, wait and see if anyone asserts SHARED
-                return INVALID_SHARING; // intermediate between I -> S and I -> E
-            } else {
-                sendBusWr(addr, procNum); 
-                return INVALID_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1; // permissions already available
-            return MODIFIED;
-        case INVALID_MODIFIED:
-            *permAvail = 0; // do nothing; snoopMI will move this state to modified eventually when DATA is received
-            return INVALID_MODIFIED;
-        case SHARING:
-            if (is_read) {
-                *permAvail = 1; // if we are reading, then permissions already available
-                return SHARING;
-            } else {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARING_MODIFIED;
-            }
-        case INVALID_SHARING:
-            *permAvail = 0; // do nothing; snoopMI will handle this case as well
-            return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            *permAvail = 0;
-            return SHARING_MODIFIED;
-        case EXCLUSIVE_CLEAN:
-            *permAvail = 1; // in E state, we already have RW permissions
-            return is_read ? EXCLUSIVE_CLEAN : MODIFIED;
-        case OWNED: // same logic as 'S' state?
-            if (is_read) {
-                *permAvail = 1;
-                return OWNED;
-            } else {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return OWNED_MODIFIED;
-            }
-        case OWNED_MODIFIED:
-            *permAvail = 0;
-            return OWNED_MODIFIED;
-        default:
-            break;
-    } return INVALID;
-}
+    if (e.actions & (PROTO_SHARED | PROTO_DATA | PROTO_ERROR))
+        runActions(e.actions, currentState, reqType, addr, procNum);
 
-coherence_states
-snoopMOESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState) {
-        case INVALID:
-            return INVALID;
-        case MODIFIED:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // since O needs to assert shared, we must assert shared when moving to O
-                sendData(addr, procNum);
-                return OWNED;
-            } else if (reqType == BUSWR) {
-                sendData(addr, procNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } return INVALID_MODIFIED;
-        case SHARING:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // indicate shared if another processor attempts to read (determines E state or not)
-                return SHARING;
-            } else if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_SHARING:
-            if (reqType == SHARED) {
-                *ca = DATA_RECV;
-                return SHARING;
-            } else if (reqType == DATA) {
-                *ca = DATA_RECV;
-                return EXCLUSIVE_CLEAN; // move to E state if we receive DATA without receiving SHARED
-            } return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) { // same as IM state, but asserts shared if we receive a BusRd
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } else if (reqType == BUSRD) indicateShared(addr, procNum);
-            return SHARING_MODIFIED;
-        case EXCLUSIVE_CLEAN:
-            if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } else if (reqType == BUSRD) {
-                indicateShared(addr, procNum);
-                return SHARING;
-            } break;
-        case OWNED:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // this will guarantee E (and consequently M) should not coexist with O
-                sendData(addr, procNum); // should be safe to send DATA here, we will never have O and M coexist on same address
-                return OWNED;
-            } else if (reqType == BUSWR) {
-                sendData(addr, procNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case OWNED_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) { // same as SM state, but also needs to sendData since it's one of O state's responsibilities
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } else if (reqType == BUSRD) {
-                indicateShared(addr, procNum);
-                sendData(addr, procNum);
-            } else if (reqType == BUSWR) sendData(addr, procNum);
-            return OWNED_MODIFIED;
-        default:
-            break;
-    } return INVALID;
-}
+    *ca = (e.actions >> PROTO_CA_SHIFT) & 0x3;
 
-coherence_states
-cacheMESIF(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch(currentState) {
-        case INVALID:
-            *permAvail = 0; // indicate permissions not available yet, need to go to intermediate state first
-            if (is_read) {
-                sendBusRd(addr, procNum); // send BusRd, wait and see if anyone asserts SHARED
-                return INVALID_SHARING; // now becomes intermediate state between I -> F and I -> E
-            } else {
-                sendBusWr(addr, procNum); 
-                return INVALID_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1; // permissions already available
-            return MODIFIED;
-        case INVALID_MODIFIED:
-            *permAvail = 0; // do nothing; snoopMI will move this state to modified eventually when DATA is received
-            return INVALID_MODIFIED;
-        case SHARING:
-            if (is_read) {
-                *permAvail = 1; // if we are reading, then permissions already available
-                return SHARING;
-            } else {
-                *permAvail = 0;
-                sendBusWr(addr, procNum); // same actions as moving from I -> M
-                return SHARING_MODIFIED;
-            }
-        case INVALID_SHARING:
-            *permAvail = 0; // do nothing; snoopMI will handle this case as well
-            return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            *permAvail = 0;
-            return SHARING_MODIFIED;
-        case EXCLUSIVE_CLEAN:
-            *permAvail = 1; // in E state, we already have RW permissions
-            return is_read ? EXCLUSIVE_CLEAN : MODIFIED;
-        case OWNED: // F state
-            if (is_read) {
-                *permAvail = 1; 
-                return OWNED;
-            } else {
-                *permAvail = 0;
-                sendBusWr(addr, procNum); 
-                return OWNED_MODIFIED; // intermediate between F and M
-            }
-        default:
-            break;
-    } return INVALID;
+    // The requester's data came either from another cache or from memory
+    if (*ca == DATA_RECV)
+    {
+        if (inter_sim->busReqCacheTransfer(addr, procNum))
+            cacheFills++;
+        else
+            memoryFills++;
+    }
+
+    transitions[currentState][CACHE_EVENTS + reqType][e.next]++;
+    return e.next;
 }
 
-coherence_states
-snoopMESIF(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum)
+void protocolReport(coherence_scheme scheme, int outFd)
 {
-    *ca = NO_ACTION;
-    switch (currentState) {
-        case INVALID:
-            return INVALID;
-        case MODIFIED:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // IMPORTANT: since we are moving to S, need to indicate shared
-                sendData(addr, procNum); 
-                return SHARING; // move M -> S if BusRd, else move M -> I
-            } else if (reqType == BUSWR) {
-                sendData(addr, procNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } return INVALID_MODIFIED;
-        case SHARING:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum); // still need this, it is possible to have S without F by going from M -> S
-                return SHARING;
-            } else if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case INVALID_SHARING:
-            if (reqType == SHARED) {
-                *ca = DATA_RECV;
-                return OWNED; // F state
-            } else if (reqType == DATA) {
-                *ca = DATA_RECV;
-                return EXCLUSIVE_CLEAN; // move to E state if we receive DATA without receiving SHARED
-            } return INVALID_SHARING;
-        case SHARING_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) { // same as IM state, but asserts shared if we receive a BusRd
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } else if (reqType == BUSRD) indicateShared(addr, procNum);
-        case EXCLUSIVE_CLEAN:
-            if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            } else if (reqType == BUSRD)  {
-                indicateShared(addr, procNum);
-                return SHARING;
-            } break;
-        case OWNED:
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum);
-                sendData(addr, procNum); // where the "FORWARD" occurs; safe to send DATA since M and F cannot coexist
-                return SHARING;
-            } else if (reqType == BUSWR) {
-                sendData(addr, procNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            } break;
-        case OWNED_MODIFIED:
-            if (reqType == DATA || reqType == SHARED) { // same as SM state, but also needs to sendData since it's one of O state's responsibilities
-                *ca = DATA_RECV;
-                return MODIFIED;
-            } else if (reqType == BUSRD) {
-                indicateShared(addr, procNum);
-                sendData(addr, procNum);
-            } else if (reqType == BUSWR) sendData(addr, procNum);
-            return OWNED_MODIFIED;
-        default:
-            break;
-    } return INVALID;
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf),
+                     "coherence messages BusRd:%lu BusWr:%lu Data:%lu "
+                     "Shared:%lu Writeback:%lu\n"
+                     "coherence fills cache:%lu memory:%lu\n"
+                     "coherence transitions %s\n",
+                     messages[BUSRD], messages[BUSWR], messages[DATA],
+                     messages[SHARED], messages[WRITEBACK], cacheFills,
+                     memoryFills, schemeNames[scheme]);
+    (void)!write(outFd, buf, n);
+
+    for (int from = 0; from < STATE_COUNT; from++)
+    {
+        for (int ev = 0; ev < EVENTS; ev++)
+        {
+            for (int to = 0; to < STATE_COUNT; to++)
+            {
+                if (transitions[from][ev][to] == 0)
+                    continue;
+                n = snprintf(buf, sizeof(buf), "  %s %s -> %s:%lu\n",
+                             stateName(scheme, from), eventNames[ev],
+                             stateName(scheme, to), transitions[from][ev][to]);
+                (void)!write(outFd, buf, n);
+            }
+        }
+    }
 }
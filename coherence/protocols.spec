@@ -0,0 +1,157 @@
+# Coherence protocols, compiled by protogen into the tables protocol.c runs.
+#
+#   protocol <name>                      starts a protocol, numbered in order
+#                                        from 0 (the -s argument)
+#   cache <state> <event> -> <next> ...  a request from the processor, the
+#                                        event is PrRd or PrWr
+#   snoop <state> <event> -> <next> ...  a request seen on the bus, the event
+#                                        is BusRd, BusWr, Data or Shared
+#
+# States are I M S E O IM IS SM OM, with F another name for O (MESIF keeps
+# its forwarder in O).  * matches every state or event, and a later line
+# overrides an earlier one.  Anything not listed goes to I and does nothing.
+#
+# The actions that can follow the next state:
+#   perm          the processor's access may proceed
+#   busrd buswr   put a request on the bus
+#   shared        assert SHARED for the request on the bus
+#   data          supply the data for the request on the bus
+#   recv          the cache receives its data
+#   inval         the cache drops the line
+#   error         the pair should not happen, report it
+
+protocol MI
+cache *  *      -> I  error
+cache I  *      -> IM buswr
+cache M  *      -> M  perm
+cache IM *      -> IM error
+snoop *  *      -> I  error
+snoop I  *      -> I
+snoop M  *      -> I  data inval
+snoop IM *      -> IM
+snoop IM Data   -> M  recv
+
+protocol MSI
+cache I  PrRd   -> IS busrd
+cache I  PrWr   -> IM buswr
+cache M  *      -> M  perm
+cache S  PrRd   -> S  perm
+cache S  PrWr   -> SM buswr
+cache IM *      -> IM
+cache IS *      -> IS
+cache SM *      -> SM
+snoop M  *      -> I  data
+snoop M  BusRd  -> S  data
+snoop M  BusWr  -> I  data inval
+snoop S  *      -> S
+snoop S  BusWr  -> I  inval
+snoop IM *      -> IM
+snoop IM Data   -> M  recv
+snoop IS *      -> IS
+snoop IS Data   -> S  recv
+snoop SM *      -> SM
+snoop SM Data   -> M  recv
+
+protocol MESI
+cache I  PrRd   -> IS busrd
+cache I  PrWr   -> IM buswr
+cache M  *      -> M  perm
+cache S  PrRd   -> S  perm
+cache S  PrWr   -> SM buswr
+cache E  PrRd   -> E  perm
+cache E  PrWr   -> M  perm
+cache IM *      -> IM
+cache IS *      -> IS
+cache SM *      -> SM
+snoop M  BusRd  -> S  shared data
+snoop M  BusWr  -> I  data inval
+snoop S  BusRd  -> S  shared
+snoop S  BusWr  -> I  inval
+snoop E  BusRd  -> S  shared
+snoop E  BusWr  -> I  inval
+snoop IM *      -> IM
+snoop IM Data   -> M  recv
+snoop IM Shared -> M  recv
+snoop IS *      -> IS
+snoop IS Data   -> E  recv
+snoop IS Shared -> S  recv
+snoop SM *      -> SM
+snoop SM BusRd  -> SM shared
+snoop SM Data   -> M  recv
+snoop SM Shared -> M  recv
+
+protocol MOESI
+cache I  PrRd   -> IS busrd
+cache I  PrWr   -> IM buswr
+cache M  *      -> M  perm
+cache S  PrRd   -> S  perm
+cache S  PrWr   -> SM buswr
+cache E  PrRd   -> E  perm
+cache E  PrWr   -> M  perm
+cache O  PrRd   -> O  perm
+cache O  PrWr   -> OM buswr
+cache IM *      -> IM
+cache IS *      -> IS
+cache SM *      -> SM
+cache OM *      -> OM
+snoop M  BusRd  -> O  shared data
+snoop M  BusWr  -> I  data inval
+snoop S  BusRd  -> S  shared
+snoop S  BusWr  -> I  inval
+snoop E  BusRd  -> S  shared
+snoop E  BusWr  -> I  inval
+snoop O  BusRd  -> O  shared data
+snoop O  BusWr  -> I  data inval
+snoop IM *      -> IM
+snoop IM Data   -> M  recv
+snoop IM Shared -> M  recv
+snoop IS *      -> IS
+snoop IS Data   -> E  recv
+snoop IS Shared -> S  recv
+snoop SM *      -> SM
+snoop SM BusRd  -> SM shared
+snoop SM Data   -> M  recv
+snoop SM Shared -> M  recv
+snoop OM *      -> OM
+snoop OM BusRd  -> OM shared data
+snoop OM BusWr  -> IM data
+snoop OM Data   -> M  recv
+snoop OM Shared -> M  recv
+
+protocol MESIF
+cache I  PrRd   -> IS busrd
+cache I  PrWr   -> IM buswr
+cache M  *      -> M  perm
+cache S  PrRd   -> S  perm
+cache S  PrWr   -> SM buswr
+cache E  PrRd   -> E  perm
+cache E  PrWr   -> M  perm
+cache F  PrRd   -> F  perm
+cache F  PrWr   -> OM buswr
+cache IM *      -> IM
+cache IS *      -> IS
+cache SM *      -> SM
+cache OM *      -> OM
+snoop M  BusRd  -> S  shared data
+snoop M  BusWr  -> I  data inval
+snoop S  BusRd  -> S  shared
+snoop S  BusWr  -> I  inval
+snoop E  BusRd  -> S  shared
+snoop E  BusWr  -> I  inval
+snoop F  BusRd  -> S  shared data
+snoop F  BusWr  -> I  data inval
+snoop IM *      -> IM
+snoop IM Data   -> M  recv
+snoop IM Shared -> M  recv
+snoop IS *      -> IS
+snoop IS Data   -> E  recv
+snoop IS Shared -> F  recv
+snoop SM *      -> SM
+snoop SM BusRd  -> SM shared
+snoop SM Data   -> M  recv
+snoop SM Shared -> M  recv
+snoop OM *      -> OM
+snoop OM BusRd  -> SM shared data
+snoop OM BusWr  -> IM data
+snoop OM Data   -> M  recv
+snoop OM Shared -> M  recv
@@ -0,0 +1,272 @@
+//
+// protogen
+//
+//   Compiles protocols.spec into protocol_tables.h, the [state][event] tables
+//   that protocol.c runs.  Every entry is written out, so a lookup never has
+//   to fall back to anything.
+//
+//   Usage: protogen <spec> <header>
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PROTOCOLS 16
+#define STATES 10  // coherence_states, UNDEF included
+#define CACHE_EVENTS 2
+#define SNOOP_EVENTS 7 // bus_req_type
+
+typedef struct _state_name {
+    const char* name;
+    const char* id;
+    int value;
+} state_name;
+
+// Values follow coherence_states in coher_internal.h
+static const state_name states[] = {
+    {"M", "MODIFIED", 1},          {"I", "INVALID", 2},
+    {"IM", "INVALID_MODIFIED", 3}, {"S", "SHARING", 4},
+    {"IS", "INVALID_SHARING", 5},  {"SM", "SHARING_MODIFIED", 6},
+    {"E", "EXCLUSIVE_CLEAN", 7},   {"O", "OWNED", 8},
+    {"F", "OWNED", 8},             {"OM", "OWNED_MODIFIED", 9},
+};
+static const char* stateIds[STATES] = {
+    "UNDEF",   "MODIFIED",         "INVALID",         "INVALID_MODIFIED",
+    "SHARING", "INVALID_SHARING",  "SHARING_MODIFIED", "EXCLUSIVE_CLEAN",
+    "OWNED",   "OWNED_MODIFIED"};
+
+// Indexed by is_read
+static const char* cacheEvents[CACHE_EVENTS] = {"PrWr", "PrRd"};
+
+// Indexed by bus_req_type, the last three never reach the coherence component
+static const char* snoopEvents[SNOOP_EVENTS]
+    = {"NoReq", "BusRd", "BusWr", "Data", "Shared", "Memory", "Writeback"};
+static const char* snoopIds[SNOOP_EVENTS]
+    = {"NO_REQ", "BUSRD", "BUSWR", "DATA", "SHARED", "MEMORY", "WRITEBACK"};
+
+static const char* actionNames[]
+    = {"perm", "busrd", "buswr", "shared", "data", "recv", "inval", "error"};
+static const char* actionIds[] = {"PROTO_PERM",   "PROTO_BUSRD", "PROTO_BUSWR",
+                                  "PROTO_SHARED", "PROTO_DATA",  "PROTO_RECV",
+                                  "PROTO_INVAL",  "PROTO_ERROR"};
+#define ACTIONS (int)(sizeof(actionNames) / sizeof(actionNames[0]))
+
+typedef struct _entry {
+    int next;
+    int actions; // bit i is actionNames[i]
+} entry;
+
+static char names[MAX_PROTOCOLS][32];
+static entry cacheTable[MAX_PROTOCOLS][STATES][CACHE_EVENTS];
+static entry snoopTable[MAX_PROTOCOLS][STATES][SNOOP_EVENTS];
+static int protocols = 0;
+
+static const char* specName;
+static int lineNum = 0;
+
+static void fail(const char* what, const char* token)
+{
+    fprintf(stderr, "%s:%d: %s '%s'\n", specName, lineNum, what, token);
+    exit(1);
+}
+
+// -1 for *
+static int stateOf(const char* token)
+{
+    if (strcmp(token, "*") == 0)
+        return -1;
+    for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+    {
+        if (strcmp(token, states[i].name) == 0)
+            return states[i].value;
+    }
+    fail("unknown state", token);
+    return 0;
+}
+
+static int eventOf(const char* token, const char** events, int count)
+{
+    if (strcmp(token, "*") == 0)
+        return -1;
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(token, events[i]) == 0)
+            return i;
+    }
+    fail("unknown event", token);
+    return 0;
+}
+
+static void setEntries(entry* table, int events, int state, int event,
+                       entry e)
+{
+    // UNDEF is never looked up, * leaves it alone
+    for (int s = 1; s < STATES; s++)
+    {
+        if (state != -1 && s != state)
+            continue;
+        for (int ev = 0; ev < events; ev++)
+        {
+            if (event == -1 || ev == event)
+                table[s * events + ev] = e;
+        }
+    }
+}
+
+static void parseLine(char* line)
+{
+    char* tokens[16];
+    int n = 0;
+
+    char* hash = strchr(line, '#');
+    if (hash)
+        *hash = '\0';
+    for (char* t = strtok(line, " \t\r\n"); t && n < 16;
+         t = strtok(NULL, " \t\r\n"))
+    {
+        tokens[n++] = t;
+    }
+    if (n == 0)
+        return;
+
+    if (strcmp(tokens[0], "protocol") == 0)
+    {
+        if (n != 2)
+            fail("expected a name after", tokens[0]);
+        if (protocols == MAX_PROTOCOLS)
+            fail("too many protocols at", tokens[1]);
+        snprintf(names[protocols], sizeof(names[0]), "%s", tokens[1]);
+
+        // Unlisted pairs go to I and do nothing
+        for (int s = 0; s < STATES; s++)
+        {
+            for (int e = 0; e < CACHE_EVENTS; e++)
+                cacheTable[protocols][s][e] = (entry){2, 0};
+            for (int e = 0; e < SNOOP_EVENTS; e++)
+                snoopTable[protocols][s][e] = (entry){2, 0};
+        }
+        protocols++;
+        return;
+    }
+
+    int isCache = strcmp(tokens[0], "cache") == 0;
+    if (!isCache && strcmp(tokens[0], "snoop") != 0)
+        fail("unknown keyword", tokens[0]);
+    if (protocols == 0)
+        fail("no protocol before", tokens[0]);
+    if (n < 5 || strcmp(tokens[3], "->") != 0)
+        fail("expected <state> <event> -> <next> after", tokens[0]);
+
+    int state = stateOf(tokens[1]);
+    int event = isCache ? eventOf(tokens[2], cacheEvents, CACHE_EVENTS)
+                        : eventOf(tokens[2], snoopEvents, SNOOP_EVENTS);
+    entry e = {stateOf(tokens[4]), 0};
+    if (e.next == -1)
+        fail("the next state cannot be", tokens[4]);
+
+    for (int i = 5; i < n; i++)
+    {
+        int a = 0;
+        while (a < ACTIONS && strcmp(tokens[i], actionNames[a]) != 0)
+            a++;
+        if (a == ACTIONS)
+            fail("unknown action", tokens[i]);
+        e.actions |= 1 << a;
+    }
+
+    if (isCache)
+        setEntries(&cacheTable[protocols - 1][0][0], CACHE_EVENTS, state,
+                   event, e);
+    else
+        setEntries(&snoopTable[protocols - 1][0][0], SNOOP_EVENTS, state,
+                   event, e);
+}
+
+static void writeEntry(FILE* out, const char* index, entry e)
+{
+    fprintf(out, "            [%s] = {%s, ", index, stateIds[e.next]);
+    if (e.actions == 0)
+        fprintf(out, "0");
+    for (int a = 0, first = 1; a < ACTIONS; a++)
+    {
+        if (e.actions & (1 << a))
+        {
+            fprintf(out, "%s%s", first ? "" : " | ", actionIds[a]);
+            first = 0;
+        }
+    }
+    fprintf(out, "},\n");
+}
+
+static void writeTable(FILE* out, const char* name, int events,
+                       const char** eventIds, int isCache)
+{
+    fprintf(out,
+            "static const protocol_entry %s[PROTOCOL_COUNT][%d][%s] = {\n",
+            name, STATES, isCache ? "2" : "SNOOP_EVENTS");
+    for (int p = 0; p < protocols; p++)
+    {
+        fprintf(out, "    [%s] = {\n", names[p]);
+        for (int s = 0; s < STATES; s++)
+        {
+            fprintf(out, "        [%s] = {\n", stateIds[s]);
+            for (int ev = 0; ev < events; ev++)
+            {
+                entry e = isCache ? cacheTable[p][s][ev] : snoopTable[p][s][ev];
+                writeEntry(out, eventIds[ev], e);
+            }
+            fprintf(out, "        },\n");
+        }
+        fprintf(out, "    },\n");
+    }
+    fprintf(out, "};\n\n");
+}
+
+int main(int argc, char** argv)
+{
+    static const char* cacheIds[CACHE_EVENTS] = {"0", "1"};
+    char line[256];
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <spec> <header>\n", argv[0]);
+        return 1;
+    }
+
+    specName = argv[1];
+    FILE* spec = fopen(specName, "r");
+    if (!spec)
+    {
+        perror(specName);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), spec))
+    {
+        lineNum++;
+        parseLine(line);
+    }
+    fclose(spec);
+
+    FILE* out = fopen(argv[2], "w");
+    if (!out)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by protogen from protocols.spec, do not edit\n\n");
+    fprintf(out, "_Static_assert(PROTOCOL_COUNT == %d,\n"
+                 "               \"protocols.spec and coherence_scheme differ\");\n",
+            protocols);
+    for (int p = 0; p < protocols; p++)
+    {
+        fprintf(out, "_Static_assert(%s == %d, \"%s is protocol %d in protocols.spec\");\n",
+                names[p], p, names[p], p);
+    }
+    fprintf(out, "\n// [scheme][state][is_read]\n");
+    writeTable(out, "cacheTable", CACHE_EVENTS, cacheIds, 1);
+    fprintf(out, "// [scheme][state][bus_req_type]\n");
+    writeTable(out, "snoopTable", SNOOP_EVENTS, snoopIds, 0);
+
+    return fclose(out) != 0;
+}
@@ -0,0 +1,274 @@
+#include "sharing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//
+// The profile keeps a set-associative table of lines; a new line replaces
+//   the way with the fewest accesses, so memory stays bounded and the busy
+//   lines are the ones kept.  For each line it remembers, per processor that
+//   touched it, the bytes touched (one bit per byte, or per blockSize / 64
+//   bytes for larger lines).  A line has slots for only a few processors,
+//   so with many sharers some invalidations go unclassified.
+//
+// An invalidation is classified when the processor next touches the line:
+//   true sharing if it touches bytes that another processor wrote since it
+//   lost the line (the invalidating write included), false sharing if not.
+//   Invalidations never followed by an access are not classified.
+//
+
+#define PROFILE_WAYS 4
+#define PROFILE_HOLDERS 8
+#define WORST_LINES 10
+
+typedef struct _holder {
+    int procNum; // -1 when the slot is free
+    int invalidated;
+    uint64_t touched; // bytes accessed since getting the line
+    uint64_t written; // bytes others wrote since losing it
+} holder;
+
+typedef struct _line_profile {
+    uint64_t key; // line address + 1, 0 when the way is empty
+    uint64_t accesses;
+    uint64_t writes;
+    uint64_t invalidations;
+    uint64_t trueSharing;
+    uint64_t falseSharing;
+    uint64_t writerChanges;
+    uint64_t migrations; // writer changes where the new writer read it first
+    uint64_t lastWrite;  // bytes of the last write
+    int firstProc;
+    int lastWriter;
+    int lastReader;
+    int shared; // some processor other than firstProc accessed it
+    holder holders[PROFILE_HOLDERS];
+} line_profile;
+
+typedef enum _sharing_pattern
+{
+    PRIVATE,
+    READ_SHARED,
+    PRODUCER_CONSUMER,
+    MIGRATORY,
+    WRITE_SHARED,
+    PATTERNS
+} sharing_pattern;
+
+static const char* patternNames[PATTERNS] = {
+    "private", "read-shared", "producer-consumer", "migratory", "write-shared"};
+
+static line_profile* lines = NULL;
+static int setBits = 0;
+
+static uint64_t invalidations = 0;
+static uint64_t trueSharing = 0;
+static uint64_t falseSharing = 0;
+
+static uint64_t byteMask(uint64_t offset, int size, int blockSize)
+{
+    uint64_t grain = (blockSize > 64) ? blockSize / 64 : 1;
+    uint64_t last = offset + ((size > 0) ? size : 1) - 1;
+
+    if (last >= (uint64_t)blockSize)
+        last = blockSize - 1;
+    return (~0UL >> (63 - last / grain)) & (~0UL << (offset / grain));
+}
+
+static line_profile* firstWay(uint64_t addr)
+{
+    uint64_t set = (addr * 0x9E3779B97F4A7C15UL) >> (64 - setBits);
+    return &lines[set * PROFILE_WAYS];
+}
+
+static line_profile* findLine(uint64_t addr)
+{
+    line_profile* set = firstWay(addr);
+    for (int w = 0; w < PROFILE_WAYS; w++)
+    {
+        if (set[w].key == addr + 1)
+            return &set[w];
+    }
+    return NULL;
+}
+
+// Starts tracking addr in place of its set's least accessed line
+static line_profile* addLine(uint64_t addr, int processorNum)
+{
+    line_profile* set = firstWay(addr);
+    line_profile* l = &set[0];
+    for (int w = 1; w < PROFILE_WAYS && l->key != 0; w++)
+    {
+        if (set[w].key == 0 || set[w].accesses < l->accesses)
+            l = &set[w];
+    }
+
+    *l = (line_profile){0};
+    l->key = addr + 1;
+    l->firstProc = processorNum;
+    l->lastWriter = l->lastReader = -1;
+    for (int h = 0; h < PROFILE_HOLDERS; h++)
+        l->holders[h].procNum = -1;
+    return l;
+}
+
+static holder* findHolder(line_profile* l, int processorNum)
+{
+    for (int h = 0; h < PROFILE_HOLDERS; h++)
+    {
+        if (l->holders[h].procNum == processorNum)
+            return &l->holders[h];
+    }
+    return NULL;
+}
+
+// A free slot, else one with no invalidation waiting to be classified
+static holder* addHolder(line_profile* l, int processorNum)
+{
+    holder* h = findHolder(l, -1);
+    for (int i = 0; h == NULL && i < PROFILE_HOLDERS; i++)
+    {
+        if (!l->holders[i].invalidated)
+            h = &l->holders[i];
+    }
+    if (h == NULL)
+        h = &l->holders[processorNum % PROFILE_HOLDERS];
+    *h = (holder){processorNum, 0, 0, 0};
+    return h;
+}
+
+static sharing_pattern patternOf(const line_profile* l)
+{
+    if (!l->shared)
+        return PRIVATE;
+    if (l->writes == 0)
+        return READ_SHARED;
+    if (l->writerChanges == 0)
+        return PRODUCER_CONSUMER;
+    if (2 * l->migrations > l->writerChanges)
+        return MIGRATORY;
+    return WRITE_SHARED;
+}
+
+void sharingInit(int bits)
+{
+    setBits = bits;
+    lines = calloc((size_t)PROFILE_WAYS << setBits, sizeof(line_profile));
+}
+
+void sharingAccess(uint8_t is_read, uint64_t addr, int size, int blockSize,
+                   int processorNum)
+{
+    uint64_t line = addr & ~(uint64_t)(blockSize - 1);
+    uint64_t mask = byteMask(addr - line, size, blockSize);
+
+    line_profile* l = findLine(line);
+    if (l == NULL)
+        l = addLine(line, processorNum);
+    l->accesses++;
+    if (processorNum != l->firstProc)
+        l->shared = 1;
+
+    holder* h = findHolder(l, processorNum);
+    if (h == NULL)
+        h = addHolder(l, processorNum);
+    if (h->invalidated)
+    {
+        int isTrue = (mask & h->written) != 0;
+        l->trueSharing += isTrue;
+        l->falseSharing += !isTrue;
+        trueSharing += isTrue;
+        falseSharing += !isTrue;
+        *h = (holder){processorNum, 0, 0, 0};
+    }
+    h->touched |= mask;
+
+    if (is_read)
+    {
+        l->lastReader = processorNum;
+        return;
+    }
+
+    l->writes++;
+    if (l->lastWriter != -1 && l->lastWriter != processorNum)
+    {
+        l->writerChanges++;
+        l->migrations += (l->lastReader == processorNum);
+    }
+    l->lastWriter = processorNum;
+    l->lastWrite = mask;
+    for (int i = 0; i < PROFILE_HOLDERS; i++)
+    {
+        if (l->holders[i].invalidated && l->holders[i].procNum != processorNum)
+            l->holders[i].written |= mask;
+    }
+}
+
+void sharingInvalidate(uint64_t addr, int processorNum)
+{
+    line_profile* l = findLine(addr);
+    holder* h = (l != NULL) ? findHolder(l, processorNum) : NULL;
+    if (h == NULL || h->invalidated)
+        return;
+
+    l->invalidations++;
+    invalidations++;
+    h->invalidated = 1;
+    h->written = (l->lastWriter != processorNum) ? l->lastWrite : 0;
+}
+
+void sharingReport(int outFd)
+{
+    line_profile* worst[WORST_LINES];
+    uint64_t patterns[PATTERNS] = {0};
+    int worstCount = 0;
+    char buf[256];
+    int n;
+
+    for (size_t i = 0; i < ((size_t)PROFILE_WAYS << setBits); i++)
+    {
+        line_profile* l = &lines[i];
+        if (l->key == 0)
+            continue;
+        patterns[patternOf(l)]++;
+        if (l->falseSharing == 0)
+            continue;
+
+        // Insertion into the worst lines, most false sharing first
+        int j = (worstCount < WORST_LINES) ? worstCount++ : WORST_LINES;
+        for (; j > 0 && worst[j - 1]->falseSharing < l->falseSharing; j--)
+        {
+            if (j < WORST_LINES)
+                worst[j] = worst[j - 1];
+        }
+        if (j < WORST_LINES)
+            worst[j] = l;
+    }
+
+    n = snprintf(buf, sizeof(buf),
+                 "sharing invalidations:%lu true:%lu false:%lu\n"
+                 "sharing lines private:%lu read-shared:%lu "
+                 "producer-consumer:%lu migratory:%lu write-shared:%lu\n",
+                 invalidations, trueSharing, falseSharing, patterns[PRIVATE],
+                 patterns[READ_SHARED], patterns[PRODUCER_CONSUMER],
+                 patterns[MIGRATORY], patterns[WRITE_SHARED]);
+    (void)!write(outFd, buf, n);
+
+    for (int i = 0; i < worstCount; i++)
+    {
+        line_profile* l = worst[i];
+        n = snprintf(buf, sizeof(buf),
+                     "  %lx %s false:%lu true:%lu invalidations:%lu "
+                     "accesses:%lu writes:%lu\n",
+                     l->key - 1, patternNames[patternOf(l)], l->falseSharing,
+                     l->trueSharing, l->invalidations, l->accesses,
+                     l->writes);
+        (void)!write(outFd, buf, n);
+    }
+}
+
+void sharingDestroy(void)
+{
+    free(lines);
+    lines = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef SHARING_H
+#define SHARING_H
+
+#include <stdint.h>
+
+//
+// The sharing profile (-f), which lines are shared how and which of their
+//   invalidations were false sharing, see sharing.c
+//
+void sharingInit(int setBits);
+
+// An access to size bytes at addr, in a line of blockSize bytes
+void sharingAccess(uint8_t is_read, uint64_t addr, int size, int blockSize,
+                   int processorNum);
+
+// processorNum lost the line at addr to another processor's write
+void sharingInvalidate(uint64_t addr, int processorNum);
+
+void sharingReport(int outFd);
+void sharingDestroy(void);
+
+#endif
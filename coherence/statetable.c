@@ -0,0 +1,234 @@
+#include "statetable.h"
+#include <stdlib.h>
+#include <string.h>
+
+//
+// One open-addressed table (linear probing, at most half full) holds every
+//   line that some processor has.  A snoop that is broadcast to every
+//   processor looks up the same line once per processor, so the last slot
+//   found is remembered and checked first.  Deletes shift the rest of the
+//   probe run back instead of leaving tombstones.
+//
+// Most lines are held by a few processors, so an entry lists its holders
+//   inline, sorted by processor, as processor << 4 | state.  Only a line
+//   with more holders than fit gets a vector of 4-bit states for every
+//   processor, which it keeps until no processor has it.  Entries stay the
+//   same size however many processors there are.  INVALID is never stored.
+//
+
+#define INLINE_HOLDERS 6
+#define STATE_BITS 4
+#define STATE_MASK ((1U << STATE_BITS) - 1)
+
+typedef struct _line_entry {
+    uint64_t key;   // line address + 1, 0 when the slot is empty
+    uint32_t count; // processors holding the line
+    uint32_t spilled;
+    union {
+        uint32_t holders[INLINE_HOLDERS]; // processor << 4 | state
+        uint8_t* states;                  // two processors a byte
+    };
+} line_entry;
+
+static line_entry* table = NULL;
+static int tableBits = 0;
+static size_t count = 0;
+static size_t lastSlot = 0;
+static int procCount = 0; // states in a spilled vector
+
+static inline size_t homeOf(uint64_t key)
+{
+    return (key * 0x9E3779B97F4A7C15UL) >> (64 - tableBits);
+}
+
+// The slot holding key, or the empty slot where it would go
+static size_t probe(uint64_t key)
+{
+    size_t mask = ((size_t)1 << tableBits) - 1;
+    if (table[lastSlot].key == key)
+        return lastSlot;
+
+    size_t slot = homeOf(key);
+    while (table[slot].key != 0 && table[slot].key != key)
+        slot = (slot + 1) & mask;
+    lastSlot = slot;
+    return slot;
+}
+
+static void allocTable(int bits)
+{
+    tableBits = bits;
+    table = calloc((size_t)1 << bits, sizeof(line_entry));
+    lastSlot = 0;
+}
+
+static void grow(void)
+{
+    line_entry* old = table;
+    size_t oldSize = (size_t)1 << tableBits;
+
+    allocTable(tableBits + 1);
+    for (size_t i = 0; i < oldSize; i++)
+    {
+        if (old[i].key != 0)
+            table[probe(old[i].key)] = old[i];
+    }
+    free(old);
+}
+
+// Empties slot, moving back the entries after it that probed past it
+static void removeSlot(size_t slot)
+{
+    size_t mask = ((size_t)1 << tableBits) - 1;
+    size_t next = slot;
+
+    if (table[slot].spilled)
+        free(table[slot].states);
+    table[slot].key = 0;
+    count--;
+    for (;;)
+    {
+        next = (next + 1) & mask;
+        if (table[next].key == 0)
+            return;
+
+        // next's entry may move to slot only if its home is not in (slot, next]
+        size_t home = homeOf(table[next].key);
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            table[slot] = table[next];
+            table[next].key = 0;
+            slot = next;
+        }
+    }
+}
+
+static inline unsigned spilledState(const line_entry* e, int processorNum)
+{
+    return (e->states[processorNum / 2] >> (processorNum % 2 * STATE_BITS))
+           & STATE_MASK;
+}
+
+static void setSpilledState(line_entry* e, int processorNum, unsigned state)
+{
+    uint8_t* b = &e->states[processorNum / 2];
+    int shift = processorNum % 2 * STATE_BITS;
+    *b = (*b & ~(STATE_MASK << shift)) | (state << shift);
+}
+
+// Moves the inline holders to a vector of every processor's state
+static void spill(line_entry* e)
+{
+    uint8_t* states = calloc((procCount + 1) / 2, 1);
+    uint32_t holders[INLINE_HOLDERS];
+
+    memcpy(holders, e->holders, sizeof(holders));
+    e->states = states;
+    e->spilled = 1;
+    for (uint32_t i = 0; i < e->count; i++)
+        setSpilledState(e, holders[i] >> STATE_BITS, holders[i] & STATE_MASK);
+}
+
+void stateTableInit(int processors)
+{
+    procCount = processors;
+    count = 0;
+    allocTable(10);
+}
+
+coherence_states stateGet(uint64_t addr, int processorNum)
+{
+    line_entry* e = &table[probe(addr + 1)];
+    if (e->key == 0)
+        return INVALID;
+
+    if (e->spilled)
+    {
+        unsigned state = spilledState(e, processorNum);
+        return (state == UNDEF) ? INVALID : state;
+    }
+    for (uint32_t i = 0; i < e->count; i++)
+    {
+        if ((int)(e->holders[i] >> STATE_BITS) == processorNum)
+            return e->holders[i] & STATE_MASK;
+    }
+    return INVALID;
+}
+
+void stateSet(uint64_t addr, int processorNum, coherence_states state)
+{
+    uint64_t key = addr + 1;
+    size_t slot = probe(key);
+    line_entry* e = &table[slot];
+
+    if (e->key == 0)
+    {
+        if (state == INVALID)
+            return;
+        if (2 * (count + 1) > ((size_t)1 << tableBits))
+        {
+            grow();
+            slot = probe(key);
+            e = &table[slot];
+        }
+        e->key = key;
+        e->count = 0;
+        e->spilled = 0;
+        count++;
+    }
+
+    if (e->spilled)
+    {
+        unsigned old = spilledState(e, processorNum);
+        unsigned stored = (state == INVALID) ? UNDEF : state;
+        setSpilledState(e, processorNum, stored);
+        e->count += (old == UNDEF) - (stored == UNDEF);
+        if (e->count == 0)
+            removeSlot(slot);
+        return;
+    }
+
+    // Find processorNum, or where it goes to keep the holders sorted
+    uint32_t i = 0;
+    while (i < e->count && (int)(e->holders[i] >> STATE_BITS) < processorNum)
+        i++;
+    int present
+        = i < e->count && (int)(e->holders[i] >> STATE_BITS) == processorNum;
+    uint32_t holder = (uint32_t)processorNum << STATE_BITS | state;
+
+    if (present && state != INVALID)
+    {
+        e->holders[i] = holder;
+    }
+    else if (present)
+    {
+        memmove(&e->holders[i], &e->holders[i + 1],
+                (e->count - i - 1) * sizeof(uint32_t));
+        if (--e->count == 0)
+            removeSlot(slot);
+    }
+    else if (state != INVALID && e->count < INLINE_HOLDERS)
+    {
+        memmove(&e->holders[i + 1], &e->holders[i],
+                (e->count - i) * sizeof(uint32_t));
+        e->holders[i] = holder;
+        e->count++;
+    }
+    else if (state != INVALID)
+    {
+        spill(e);
+        setSpilledState(e, processorNum, state);
+        e->count++;
+    }
+}
+
+void stateTableDestroy(void)
+{
+    for (size_t i = 0; table && i < ((size_t)1 << tableBits); i++)
+    {
+        if (table[i].key != 0 && table[i].spilled)
+            free(table[i].states);
+    }
+    free(table);
+    table = NULL;
+}
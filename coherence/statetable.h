@@ -0,0 +1,18 @@
+#ifndef STATETABLE_H
+#define STATETABLE_H
+
+#include <stdint.h>
+#include "coher_internal.h"
+
+//
+// The coherence state of every line, for every processor, see statetable.c
+//
+void stateTableInit(int processors);
+coherence_states stateGet(uint64_t addr, int processorNum);
+
+// INVALID is not stored, a line leaves the table once no processor has it
+void stateSet(uint64_t addr, int processorNum, coherence_states state);
+
+void stateTableDestroy(void);
+
+#endif
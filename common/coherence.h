@@ -28,6 +28,13 @@ typedef struct _coher {
     uint8_t (*permReq)(uint8_t is_read, uint64_t addr, int processorNum);
     uint8_t (*invlReq)(uint64_t addr, int processorNum);
     uint8_t (*busReq)(bus_req_type reqType, uint64_t addr, int processorNum);
+    // The interconnect takes addr back from a processor's cache (a snoop
+    // filter back-invalidating): the cache drops it, dirty data is written back
+    uint8_t (*recallReq)(uint64_t addr, int processorNum);
+    // The cache reports every access, size bytes at memAddress in a line of
+    // blockSize bytes, ahead of its permReq; only the sharing profile uses it
+    void (*noteAccess)(uint8_t is_read, uint64_t memAddress, int size,
+                       int blockSize, int processorNum);
     debug_env_vars dbgEnv;
 } coher;
 
@@ -26,6 +26,15 @@ typedef struct _sim_interface {
 extern int CADSS_VERBOSE;
 extern int processorCount;
 
+// Processor numbers fit in 16 bits, e.g. in the processor's memory op tags
+#define CADSS_PROC_BITS 16
+#define CADSS_MAX_PROCESSORS (1 << CADSS_PROC_BITS)
+
+// Flag set by engine while fast-forwarding (functional warmup), components
+// that define it should update their state without modeling any time and
+// respond to requests immediately.  The engine clears it when timing starts.
+extern int CADSS_FUNCTIONAL;
+
 // For cadss debugging functionality.
 typedef struct _debug_env_vars {
     int cadssDbgWatchedComp;
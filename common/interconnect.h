@@ -11,7 +11,8 @@ typedef enum _bus_req_type
     BUSWR,
     DATA,
     SHARED,
-    MEMORY
+    MEMORY,
+    WRITEBACK // an evicted dirty line going to memory, not snooped
 } bus_req_type;
 
 #include "coherence.h"
@@ -29,6 +30,15 @@ typedef struct _interconn {
     void (*busReq)(bus_req_type brt, uint64_t addr, int procNum);
     void (*registerCoher)(struct _coher* coherComp);
     int (*busReqCacheTransfer)(uint64_t addr, int procNum);
+    // A directory registers the lookup of which processors a request has to
+    // reach; the request is then sent only to them instead of broadcast.
+    // The lookup fills procs (room for processorCount) and returns how many.
+    // It is also told of each writeback when it is issued, and of requests
+    // made in functional warmup, so it can keep its entries; those reach no
+    // one, and a writeback's procs is NULL.
+    void (*registerSnoopTargets)(int (*targets)(bus_req_type brt,
+                                                uint64_t addr, int procNum,
+                                                int* procs));
     debug_env_vars dbgEnv;
 } interconn;
 
@@ -42,6 +42,7 @@ typedef struct _trace_sim_args {
 typedef struct _trace_reader {
     sim_interface si;
     trace_op* (*getNextOp)(int);
+    int (*inWarmup)(void);
 } trace_reader;
 
 #endif
@@ -0,0 +1,339 @@
+#include "directory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//
+// The directory component is the coherence component with a home-node
+//   directory: each line has an entry at its home naming the processors
+//   that may hold it, and a request is sent from the home only to those
+//   processors instead of being broadcast.  The caches run the same
+//   per-processor protocol (-s) as with snooping.
+//
+// The entry is kept from the requests the home orders, not read from the
+//   caches.  A read adds the requester, a write leaves the requester alone
+//   in it, and a writeback takes the writer out.  A clean line is dropped
+//   silently, so the entry may still name a processor that no longer has
+//   it; that processor is sent a forward and ignores it.
+//
+// By default an entry is a full bit vector, a bit per processor.  With -p n
+//   it has only n pointers (Dir_n B): one more sharer overflows it, and the
+//   home no longer knows who has the line and broadcasts its requests until
+//   a write leaves a single holder again.
+//
+// The interconnect carries the messages: a request to the home, a forward
+//   from the home to each processor named, and from each processor a write
+//   invalidated an acknowledgement, or the line itself, to the requester.
+//   The line comes from a cache or from the home's memory.
+//
+// The entries of every home share one open-addressed table (linear probing,
+//   at most half full); deletes shift the rest of the probe run back, as in
+//   the state table.
+//
+
+extern int processorCount;
+extern int CADSS_FUNCTIONAL;
+
+typedef struct _dir_entry {
+    uint64_t key;      // line address + 1, 0 when the slot is empty
+    uint32_t count;    // sharers named
+    uint32_t overflow; // more sharers than pointers, every processor may
+    uint64_t map[];    // a bit per processor, or pointerCount 16-bit pointers
+} dir_entry;
+
+static int pointerCount = 0; // 0 is a full bit vector
+static size_t entryBytes = 0;
+
+static char* table = NULL;
+static int tableBits = 0;
+static size_t count = 0;
+
+static uint64_t reads = 0;
+static uint64_t writes = 0;
+static uint64_t forwards = 0;
+static uint64_t invalidations = 0;
+static uint64_t writebacks = 0;
+static uint64_t overflows = 0;
+static uint64_t broadcasts = 0;
+static size_t peakEntries = 0;
+
+static inline dir_entry* slotAt(size_t slot)
+{
+    return (dir_entry*)(table + slot * entryBytes);
+}
+
+static inline size_t homeOf(uint64_t key)
+{
+    return (key * 0x9E3779B97F4A7C15UL) >> (64 - tableBits);
+}
+
+// The slot holding key, or the empty slot where it would go
+static size_t probe(uint64_t key)
+{
+    size_t mask = ((size_t)1 << tableBits) - 1;
+    size_t slot = homeOf(key);
+
+    while (slotAt(slot)->key != 0 && slotAt(slot)->key != key)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static void allocTable(int bits)
+{
+    tableBits = bits;
+    table = calloc((size_t)1 << bits, entryBytes);
+}
+
+static void grow(void)
+{
+    char* old = table;
+    size_t oldSize = (size_t)1 << tableBits;
+
+    allocTable(tableBits + 1);
+    for (size_t i = 0; i < oldSize; i++)
+    {
+        dir_entry* e = (dir_entry*)(old + i * entryBytes);
+        if (e->key != 0)
+            memcpy(slotAt(probe(e->key)), e, entryBytes);
+    }
+    free(old);
+}
+
+// Empties slot, moving back the entries after it that probed past it
+static void removeSlot(size_t slot)
+{
+    size_t mask = ((size_t)1 << tableBits) - 1;
+    size_t next = slot;
+
+    slotAt(slot)->key = 0;
+    count--;
+    for (;;)
+    {
+        next = (next + 1) & mask;
+        if (slotAt(next)->key == 0)
+            return;
+
+        // next's entry may move to slot only if its home is not in (slot, next]
+        size_t home = homeOf(slotAt(next)->key);
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            memcpy(slotAt(slot), slotAt(next), entryBytes);
+            slotAt(next)->key = 0;
+            slot = next;
+        }
+    }
+}
+
+static inline uint16_t* pointers(dir_entry* e)
+{
+    return (uint16_t*)e->map;
+}
+
+static int named(dir_entry* e, int procNum)
+{
+    if (pointerCount == 0)
+        return (e->map[procNum / 64] >> (procNum % 64)) & 1;
+
+    for (uint32_t i = 0; i < e->count; i++)
+    {
+        if (pointers(e)[i] == procNum)
+            return 1;
+    }
+    return 0;
+}
+
+static void addSharer(dir_entry* e, int procNum)
+{
+    if (e->overflow || named(e, procNum))
+        return;
+
+    if (pointerCount == 0)
+    {
+        e->map[procNum / 64] |= 1UL << (procNum % 64);
+    }
+    else if (e->count == (uint32_t)pointerCount)
+    {
+        e->overflow = 1;
+        if (!CADSS_FUNCTIONAL)
+            overflows++;
+        return;
+    }
+    else
+    {
+        pointers(e)[e->count] = procNum;
+    }
+    e->count++;
+}
+
+static void removeSharer(dir_entry* e, int procNum)
+{
+    if (e->overflow || !named(e, procNum))
+        return;
+
+    if (pointerCount == 0)
+    {
+        e->map[procNum / 64] &= ~(1UL << (procNum % 64));
+    }
+    else
+    {
+        uint16_t* p = pointers(e);
+        uint32_t i = 0;
+        while (p[i] != procNum)
+            i++;
+        p[i] = p[e->count - 1];
+    }
+    e->count--;
+}
+
+// Fills procs with the processors other than procNum that e names
+static int sharers(dir_entry* e, int procNum, int* procs)
+{
+    int n = 0;
+
+    if (e->overflow)
+    {
+        for (int i = 0; i < processorCount; i++)
+        {
+            if (i != procNum)
+                procs[n++] = i;
+        }
+    }
+    else if (pointerCount == 0)
+    {
+        int words = (processorCount + 63) / 64;
+        for (int w = 0; w < words; w++)
+        {
+            for (uint64_t bits = e->map[w]; bits != 0; bits &= bits - 1)
+            {
+                int p = w * 64 + __builtin_ctzl(bits);
+                if (p != procNum)
+                    procs[n++] = p;
+            }
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < e->count; i++)
+        {
+            if (pointers(e)[i] != procNum)
+                procs[n++] = pointers(e)[i];
+        }
+    }
+    return n;
+}
+
+// The home orders a request, or is sent a writeback, see interconnect.h
+static int snoopTargets(bus_req_type brt, uint64_t addr, int procNum,
+                        int* procs)
+{
+    uint64_t key = addr + 1;
+    size_t slot = probe(key);
+    dir_entry* e = slotAt(slot);
+
+    if (brt == WRITEBACK)
+    {
+        if (!CADSS_FUNCTIONAL)
+            writebacks++;
+        if (e->key != 0)
+        {
+            removeSharer(e, procNum);
+            if (e->count == 0 && !e->overflow)
+                removeSlot(slot);
+        }
+        return 0;
+    }
+
+    if (e->key == 0)
+    {
+        if (2 * (count + 1) > ((size_t)1 << tableBits))
+        {
+            grow();
+            slot = probe(key);
+            e = slotAt(slot);
+        }
+        memset(e, 0, entryBytes);
+        e->key = key;
+        count++;
+        if (count > peakEntries)
+            peakEntries = count;
+    }
+
+    int n = sharers(e, procNum, procs);
+    if (!CADSS_FUNCTIONAL)
+    {
+        if (brt == BUSWR)
+        {
+            writes++;
+            invalidations += n;
+        }
+        else
+        {
+            reads++;
+        }
+        forwards += n;
+        broadcasts += e->overflow;
+    }
+
+    // A write leaves the requester the only holder
+    if (brt == BUSWR)
+    {
+        memset(e->map, 0, entryBytes - sizeof(dir_entry));
+        e->count = 0;
+        e->overflow = 0;
+    }
+    addSharer(e, procNum);
+
+    return n;
+}
+
+void directoryInit(interconn* inter, int pointers)
+{
+    pointerCount = pointers;
+    if (pointerCount == 0)
+        entryBytes = sizeof(dir_entry)
+                     + sizeof(uint64_t) * ((processorCount + 63) / 64);
+    else
+        entryBytes = sizeof(dir_entry)
+                     + sizeof(uint64_t) * ((pointerCount + 3) / 4);
+    count = 0;
+    allocTable(10);
+
+    inter->registerSnoopTargets(snoopTargets);
+}
+
+//
+// The messages count each request and writeback to the home, each forward
+//   and each answer to an invalidation, the acknowledgement or the line.
+//   Broadcast would forward every request to every other processor and have
+//   all of them answer a write.  The line memory sends is the same either
+//   way and left out.
+//
+void directoryFinish(int outFd)
+{
+    char buf[320];
+    uint64_t requests = reads + writes;
+    uint64_t messages = requests + writebacks + forwards + invalidations;
+    uint64_t broadcast = requests + writebacks
+                         + (requests + writes) * (processorCount - 1);
+    int bits = pointerCount ? pointerCount * CADSS_PROC_BITS + 1
+                            : processorCount;
+
+    int n = snprintf(buf, sizeof(buf),
+                     "directory reads:%lu writes:%lu writebacks:%lu "
+                     "forwards:%lu invalidations:%lu average forwards:%.2f\n"
+                     "directory messages:%lu broadcast:%lu\n"
+                     "directory %s overflows:%lu broadcast requests:%lu "
+                     "peak entries:%zu bits per entry:%d\n",
+                     reads, writes, writebacks, forwards, invalidations,
+                     requests ? (double)forwards / requests : 0.0, messages,
+                     broadcast, pointerCount ? "limited pointers" : "full map",
+                     overflows, broadcasts, peakEntries, bits);
+    (void)!write(outFd, buf, n);
+}
+
+void directoryDestroy(void)
+{
+    free(table);
+    table = NULL;
+}
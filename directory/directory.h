@@ -0,0 +1,13 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <interconnect.h>
+
+//
+// Home-node directory on top of the coherence component, see directory.c
+//
+void directoryInit(interconn* inter, int pointers);
+void directoryFinish(int outFd);
+void directoryDestroy(void);
+
+#endif
@@ -94,18 +94,19 @@ static void parseSettings()
         // As we know the last character is '\0', a non-NULL
         //   character will always have another character after
         //   it.  And that configContents[length] == '\0'.
-        if (configContents[pos] == '/')
+        //   Any other '/' starts an argument, such as an absolute path.
+        if (configContents[pos] == '/'
+            && (configContents[pos + 1] == '/' || configContents[pos + 1] == '*'))
         {
             if (configContents[pos + 1] == '/')
             {
                 inComment = 1;
-                pos += 2;
             }
-            else if (configContents[pos + 1] == '*')
+            else
             {
                 inMultiComment = 1;
-                pos += 2;
             }
+            pos += 2;
             continue;
         }
         
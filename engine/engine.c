@@ -12,8 +12,14 @@
 #include "engine.h"
 
 int CADSS_VERBOSE = 0;
+int CADSS_FUNCTIONAL = 0;
 int processorCount = 1;
 
+// Every loaded component, so that mode changes can be pushed to each
+#define MAX_LOADED_SIMS 16
+struct sim* loadedSims[MAX_LOADED_SIMS];
+int loadedSimCount = 0;
+
 void printHelp(char* prog)
 {
     printf("%s \n", prog);
@@ -28,6 +34,12 @@ void printHelp(char* prog)
     printf("  -m <file>   \t Memory simulator\n");
     printf("  -t <file>   \t Trace file / directory\n");
     printf("  -s <file>   \t Setting / configuration file\n");
+    printf("  -r          \t Region of interest only (taskgraph traces)\n"
+           "              \t  - tasks before ROIStart are fast-forwarded\n"
+           "              \t    functionally to warm caches and coherence\n"
+           "              \t  - simulation stops after ROIEnd\n");
+    printf("  -w <ops>    \t Warm up functionally for the first <ops> trace\n"
+           "              \t ops, then simulate the rest with timing\n");
     printf("  -d [<tick>] \t Enable debugging\n"
            "              \t  - drops into a debug REPL\n"
            "              \t  - if <tick> specified, waits for <tick>\n"
@@ -88,6 +100,12 @@ struct sim* loadSim(char* name, char* type)
         *(s->CADSS_VERBOSE) = CADSS_VERBOSE;
     }
 
+    s->CADSS_FUNCTIONAL = dlsym(handle, "CADSS_FUNCTIONAL");
+    if (s->CADSS_FUNCTIONAL != NULL)
+    {
+        *(s->CADSS_FUNCTIONAL) = CADSS_FUNCTIONAL;
+    }
+
     int* pCount = dlsym(handle, "processorCount");
     if (pCount != NULL)
     {
@@ -102,9 +120,30 @@ struct sim* loadSim(char* name, char* type)
         fprintf(stderr, "Failed to load interface for %s component\n", type);
         return NULL;
     }
+
+    if (loadedSimCount < MAX_LOADED_SIMS)
+    {
+        loadedSims[loadedSimCount++] = s;
+    }
     return s;
 }
 
+//
+// setFunctional (mode)
+//    Switches every loaded component between functional and timing mode
+//
+static void setFunctional(int mode)
+{
+    CADSS_FUNCTIONAL = mode;
+    for (int i = 0; i < loadedSimCount; i++)
+    {
+        if (loadedSims[i]->CADSS_FUNCTIONAL != NULL)
+        {
+            *(loadedSims[i]->CADSS_FUNCTIONAL) = mode;
+        }
+    }
+}
+
 // Handle debug REPL prompts.
 static int debugRepl(int64_t tickCount)
 {
@@ -200,7 +239,7 @@ int main(int argc, char** argv)
     char* memName = NULL;
 
     // TODO - switch to getopt_long that accepts -- arguments
-    while ((opt = getopt(argc, argv, ":hvc:p:o:n:i:b:t:s:m:d:")) != -1)
+    while ((opt = getopt(argc, argv, ":hvrc:p:o:n:i:b:t:s:m:d:w:")) != -1)
     {
         switch (opt)
         {
@@ -221,6 +260,13 @@ int main(int argc, char** argv)
             case 'v':
                 CADSS_VERBOSE = 1;
                 break;
+            case 'r':
+                CADSS_FUNCTIONAL = 1;
+                break;
+            case 'w':
+                if (atol(optarg) > 0)
+                    CADSS_FUNCTIONAL = 1;
+                break;
             case 'c':
                 cacheName = optarg;
                 break;
@@ -251,6 +297,13 @@ int main(int argc, char** argv)
         }
     }
 
+    if (processorCount < 1 || processorCount > CADSS_MAX_PROCESSORS)
+    {
+        fprintf(stderr, "Processor count must be 1 to %d - %d specified\n",
+                CADSS_MAX_PROCESSORS, processorCount);
+        return 0;
+    }
+
     if (isProcTracedExt() && CADSS_DBG_ON)
         CADSS_DBG_EXT = 1;
 
@@ -439,6 +492,13 @@ int main(int argc, char** argv)
 
     do
     {
+        // Once the trace reaches the timed region (or -w ops were read),
+        // leave functional mode.
+        if (CADSS_FUNCTIONAL && !tr->inWarmup())
+        {
+            setFunctional(0);
+        }
+
         dbgHalt = debugRepl(dbgTickCount);
         if (dbgHalt)
             break;
@@ -463,6 +523,14 @@ int main(int argc, char** argv)
         debugCheckNotif(&(coher_sim->dbgEnv));
         debugCheckNotif(&(inter_sim->dbgEnv));
         debugCheckNotif(&(mem_sim->dbgEnv));
+
+        // No progress while warming up means every processor is waiting at
+        // the timed region (or the trace ended), so start timing from here.
+        if (CADSS_FUNCTIONAL && !progress)
+        {
+            setFunctional(0);
+            progress = 1;
+        }
     } while (progress);
 
     psim->finish(STDOUT_FILENO);
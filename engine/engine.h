@@ -35,6 +35,7 @@ struct sim {
     int (*finish)(int);
     int (*destroy)(void);
     int* CADSS_VERBOSE;
+    int* CADSS_FUNCTIONAL;
 };
 
 // Engine started with "-d".
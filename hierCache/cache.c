@@ -0,0 +1,731 @@
+#include <cache.h>
+#include <trace.h>
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <coherence.h>
+
+//
+// hierCache - a chain of cache levels for each processor
+//
+//   Every processor has its own private levels (L1, L2, ...), given in order
+// with -L, and optionally all of them share one last level cache, given with
+// -C.  Each level takes its own options:
+//
+//     -E <lines per set> -s <set bits> -b <block bits>
+//     -l <lookup latency> -p inclusive|exclusive|nine
+//
+// e.g. -L "-E 8 -s 6 -b 6 -l 4" -L "-E 8 -s 9 -b 6 -l 12" -C "-E 16 -s 11 -l 40"
+//
+//   The policy of a level says how it holds the lines of the levels above it.
+// An inclusive level holds all of them, and evicting a line from it removes
+// the line from the levels above (for the shared level, from every
+// processor).  An exclusive level only holds lines evicted from the level
+// above, and gives a line up when it moves back up.  A NINE level is filled
+// along with the levels above but never removes lines from them.
+//
+//   Permissions come from the coherence component, at the granularity of the
+// first level's blocks.  Once a processor has permission, the latency of an
+// access is the lookup latency of every level down to the one that has the
+// line, plus -M (memory latency) if none does.  A processor keeps its
+// permission while the shared level has the line, so a hit there is not sent
+// to the bus.  When the coherence component has to go to the bus, the data
+// arrives with its callback and then takes the same latency, at least that of
+// filling through the private levels.
+//
+
+typedef enum
+{
+    INCLUSIVE,
+    EXCLUSIVE,
+    NINE
+} incl_policy;
+
+typedef struct _level_config {
+    int E;
+    int s;
+    int b;
+    int latency;
+    incl_policy policy;
+    const char* name;
+} level_config;
+
+typedef struct _level_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks;
+    uint64_t backInvalidations;
+} level_stats;
+
+typedef struct _level {
+    level_config* cfg;
+    uint64_t* tags;   // line addresses, S * E
+    uint8_t* state;   // LINE_VALID | LINE_DIRTY
+    uint64_t* used;   // last use, for LRU
+    uint64_t useCount;
+    level_stats* stats;
+} level;
+
+#define LINE_VALID 1
+#define LINE_DIRTY 2
+#define MAX_LEVELS 8
+#define NO_BLOCK UINT64_MAX
+
+cache* self = NULL;
+
+int processorCount = 1;
+int CADSS_VERBOSE = 0;
+int CADSS_FUNCTIONAL = 0;
+
+coher* coherComp = NULL;
+
+level_config configs[MAX_LEVELS];
+level_stats levelStats[MAX_LEVELS];  // private levels summed over processors
+int privateLevels = 0;
+int hasShared = 0;
+int memLatency = 100;
+
+level* privates = NULL;  // every processor's private levels, processor by processor
+level shared;
+
+static inline level* privateLevel(int processorNum, int i)
+{
+    return &privates[(size_t)processorNum * privateLevels + i];
+}
+
+void coherCallback(int type, int processorNum, int64_t addr);
+void memoryRequest(trace_op* op, int processorNum, int64_t tag,
+                   void (*callback)(int, int64_t));
+
+//
+// parseLevel
+//
+//   Reads "-E 8 -s 6 ..." into a level_config.  This is done by hand, as
+// getopt is in the middle of parsing the component's own arguments.
+//
+static int parseLevel(char* arg, level_config* cfg, const char* name)
+{
+    char* save = NULL;
+    char* flag = strtok_r(arg, " \t", &save);
+
+    *cfg = (level_config){.E = 1, .s = 0, .b = 6, .latency = 1,
+                          .policy = NINE, .name = name};
+    while (flag != NULL)
+    {
+        char* value = strtok_r(NULL, " \t", &save);
+        if (flag[0] != '-' || value == NULL)
+        {
+            fprintf(stderr, "Bad option %s for cache level %s\n", flag, name);
+            return 0;
+        }
+
+        switch (flag[1])
+        {
+            case 'E':
+                cfg->E = atoi(value);
+                break;
+            case 's':
+                cfg->s = atoi(value);
+                break;
+            case 'b':
+                cfg->b = atoi(value);
+                break;
+            case 'l':
+                cfg->latency = atoi(value);
+                break;
+            case 'p':
+                if (strcmp(value, "inclusive") == 0)
+                    cfg->policy = INCLUSIVE;
+                else if (strcmp(value, "exclusive") == 0)
+                    cfg->policy = EXCLUSIVE;
+                else if (strcmp(value, "nine") == 0)
+                    cfg->policy = NINE;
+                else
+                    fprintf(stderr, "Unknown inclusion policy %s, using nine\n",
+                            value);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %s for cache level %s\n", flag,
+                        name);
+                return 0;
+        }
+        flag = strtok_r(NULL, " \t", &save);
+    }
+
+    if (cfg->E < 1)
+        cfg->E = 1;
+    return 1;
+}
+
+static void initLevel(level* l, level_config* cfg, level_stats* stats)
+{
+    size_t lines = (size_t)cfg->E << cfg->s;
+    l->cfg = cfg;
+    l->tags = calloc(lines, sizeof(uint64_t));
+    l->state = calloc(lines, sizeof(uint8_t));
+    l->used = calloc(lines, sizeof(uint64_t));
+    l->useCount = 0;
+    l->stats = stats;
+}
+
+static void freeLevel(level* l)
+{
+    free(l->tags);
+    free(l->state);
+    free(l->used);
+}
+
+static const char* levelNames[MAX_LEVELS]
+    = {"L1", "L2", "L3", "L4", "L5", "L6", "L7", "L8"};
+
+cache* init(cache_sim_args* csa)
+{
+    int op;
+    char* sharedArg = NULL;
+
+    while ((op = getopt(csa->arg_count, csa->arg_list, "L:C:M:")) != -1)
+    {
+        switch (op)
+        {
+            // A private level, the first one given is L1
+            case 'L':
+                if (privateLevels == MAX_LEVELS - 1)
+                {
+                    fprintf(stderr, "At most %d private levels\n",
+                            MAX_LEVELS - 1);
+                    break;
+                }
+                if (parseLevel(optarg, &configs[privateLevels],
+                               levelNames[privateLevels]))
+                    privateLevels++;
+                break;
+
+            // The shared last level
+            case 'C':
+                sharedArg = optarg;
+                break;
+
+            // Memory latency
+            case 'M':
+                memLatency = atoi(optarg);
+                break;
+        }
+    }
+
+    if (privateLevels == 0)
+    {
+        fprintf(stderr, "No private levels given, using a single -E 1 -s 0 "
+                        "-b 6 level\n");
+        parseLevel((char[]){""}, &configs[0], levelNames[0]);
+        privateLevels = 1;
+    }
+    if (sharedArg != NULL
+        && parseLevel(sharedArg, &configs[privateLevels], "LLC"))
+    {
+        hasShared = 1;
+    }
+
+    // Moving lines between exclusive levels needs the same block size, and a
+    // level never has smaller blocks than the one above it.
+    int levels = privateLevels + hasShared;
+    for (int i = 1; i < levels; i++)
+    {
+        if (configs[i].b < configs[i - 1].b)
+        {
+            fprintf(stderr, "%s has smaller blocks than the level above, "
+                            "using -b %d\n", configs[i].name, configs[i - 1].b);
+            configs[i].b = configs[i - 1].b;
+        }
+        if (configs[i].policy == EXCLUSIVE && configs[i].b != configs[i - 1].b)
+        {
+            fprintf(stderr, "Exclusive %s needs the block size of the level "
+                            "above, using nine\n", configs[i].name);
+            configs[i].policy = NINE;
+        }
+    }
+
+    privates = calloc((size_t)processorCount * privateLevels, sizeof(level));
+    for (int p = 0; p < processorCount; p++)
+    {
+        for (int i = 0; i < privateLevels; i++)
+            initLevel(privateLevel(p, i), &configs[i], &levelStats[i]);
+    }
+    if (hasShared)
+        initLevel(&shared, &configs[privateLevels], &levelStats[privateLevels]);
+
+    self = malloc(sizeof(cache));
+    self->memoryRequest = memoryRequest;
+    self->si.tick = tick;
+    self->si.finish = finish;
+    self->si.destroy = destroy;
+
+    coherComp = csa->coherComp;
+    coherComp->registerCacheInterface(coherCallback);
+
+    return self;
+}
+
+// the levels that processor p sees, from L1 down, returns how many
+static int chainOf(int p, level** chain)
+{
+    int n = 0;
+    for (int i = 0; i < privateLevels; i++)
+        chain[n++] = privateLevel(p, i);
+    if (hasShared)
+        chain[n++] = &shared;
+    return n;
+}
+
+// returns the index (set * E + way) holding addr, or -1
+static int findLine(level* l, uint64_t addr)
+{
+    uint64_t line = addr >> l->cfg->b;
+    uint64_t set = line & ((1UL << l->cfg->s) - 1);
+    size_t base = set * l->cfg->E;
+    for (int w = 0; w < l->cfg->E; w++)
+    {
+        if ((l->state[base + w] & LINE_VALID) && l->tags[base + w] == line)
+            return base + w;
+    }
+    return -1;
+}
+
+// the counters of l, functional warmup counts into a copy that is never shown
+static level_stats* statsOf(level* l)
+{
+    static level_stats warmup;
+    return CADSS_FUNCTIONAL ? &warmup : l->stats;
+}
+
+static void touchLine(level* l, int index)
+{
+    l->used[index] = ++l->useCount;
+}
+
+// Removes every line of the block [addr, addr + 2^b) from l, returns how many
+//   were there and ORs their dirty bits into *dirty.
+static int removeBlock(level* l, uint64_t addr, int b, uint8_t* dirty)
+{
+    int removed = 0;
+    uint64_t base = addr >> b << b;
+    for (uint64_t a = base; a < base + (1UL << b); a += 1UL << l->cfg->b)
+    {
+        int index = findLine(l, a);
+        if (index == -1)
+            continue;
+        *dirty |= l->state[index] & LINE_DIRTY;
+        l->state[index] = 0;
+        removed++;
+    }
+    return removed;
+}
+
+static void fillLevel(int p, level** chain, int n, int i, uint64_t addr,
+                      uint8_t dirty);
+
+// whether any of processor p's private levels has addr
+static int heldPrivately(int p, uint64_t addr)
+{
+    for (int i = 0; i < privateLevels; i++)
+    {
+        if (findLine(privateLevel(p, i), addr) != -1)
+            return 1;
+    }
+    return 0;
+}
+
+//
+// released
+//
+//   Hands the L1 blocks of [addr, addr + 2^b) that processor p no longer has,
+// in a private level or in the shared level, back to the coherence component,
+// so that it only keeps state for what the caches hold.  The block at skip is
+// left alone.
+//
+static void released(int p, uint64_t addr, int b, uint64_t skip)
+{
+    uint64_t base = addr >> b << b;
+    for (uint64_t a = base; a < base + (1UL << b); a += 1UL << configs[0].b)
+    {
+        if (a == skip || heldPrivately(p, a)
+            || (hasShared && findLine(&shared, a) != -1))
+            continue;
+        coherComp->invlReq(a, p);
+    }
+}
+
+//
+// evicted
+//
+//   Level i of processor p's chain gave up the block at addr.  An inclusive
+// level takes it out of the levels above, then the block moves into an
+// exclusive level below, or its dirty data is written to the next level
+// holding it.
+//
+static void evicted(int p, level** chain, int n, int i, uint64_t addr,
+                    uint8_t dirty)
+{
+    level* l = chain[i];
+    statsOf(l)->evictions++;
+
+    if (l->cfg->policy == INCLUSIVE && i > 0)
+    {
+        int procs = (l == &shared) ? processorCount : 1;
+        for (int q = 0; q < procs; q++)
+        {
+            level* upper[MAX_LEVELS];
+            int removed = 0;
+            if (l == &shared)
+                chainOf(q, upper);
+            else
+                memcpy(upper, chain, sizeof(level*) * i);
+            for (int j = 0; j < i; j++)
+                removed += removeBlock(upper[j], addr, l->cfg->b, &dirty);
+            statsOf(l)->backInvalidations += removed;
+        }
+    }
+
+    if (i + 1 < n && chain[i + 1]->cfg->policy == EXCLUSIVE)
+    {
+        fillLevel(p, chain, n, i + 1, addr, dirty);
+    }
+    else if (dirty)
+    {
+        int j = i + 1;
+        while (j < n && findLine(chain[j], addr) == -1)
+            j++;
+        if (j < n)
+            chain[j]->state[findLine(chain[j], addr)] |= LINE_DIRTY;
+        else
+            statsOf(l)->writebacks++;
+    }
+
+    // Every processor may have kept permission for the block in the shared level
+    int procs = (l == &shared) ? processorCount : 1;
+    for (int q = 0; q < procs; q++)
+        released(l == &shared ? q : p, addr, l->cfg->b, NO_BLOCK);
+}
+
+// puts addr into level i of the chain, evicting its LRU line if needed
+static void fillLevel(int p, level** chain, int n, int i, uint64_t addr,
+                      uint8_t dirty)
+{
+    level* l = chain[i];
+    uint64_t line = addr >> l->cfg->b;
+    uint64_t set = line & ((1UL << l->cfg->s) - 1);
+    size_t base = set * l->cfg->E;
+    int victim = base;
+
+    int index = findLine(l, addr);
+    if (index != -1)
+    {
+        l->state[index] |= dirty;
+        touchLine(l, index);
+        return;
+    }
+
+    for (int w = 0; w < l->cfg->E; w++)
+    {
+        if (!(l->state[base + w] & LINE_VALID))
+        {
+            victim = base + w;
+            break;
+        }
+        if (l->used[base + w] < l->used[victim])
+            victim = base + w;
+    }
+
+    uint8_t old = l->state[victim];
+    uint64_t oldAddr = l->tags[victim] << l->cfg->b;
+    l->tags[victim] = line;
+    l->state[victim] = LINE_VALID | dirty;
+    touchLine(l, victim);
+
+    if (old & LINE_VALID)
+        evicted(p, chain, n, i, oldAddr, old & LINE_DIRTY);
+}
+
+//
+// lookup
+//
+//   Looks addr up from L1 down and moves the line up to L1, returns the
+// latency of the access.
+//
+static int lookup(int p, uint64_t addr, int store)
+{
+    level* chain[MAX_LEVELS];
+    int n = chainOf(p, chain);
+    int latency = 0;
+    int found = -1;
+
+    for (int i = 0; i < n; i++)
+    {
+        latency += chain[i]->cfg->latency;
+        int index = findLine(chain[i], addr);
+        if (index != -1)
+        {
+            statsOf(chain[i])->hits++;
+            found = i;
+            break;
+        }
+        statsOf(chain[i])->misses++;
+    }
+    if (found == -1)
+    {
+        latency += memLatency;
+        found = n;
+    }
+
+    uint8_t dirty = store ? LINE_DIRTY : 0;
+    if (found < n)
+    {
+        level* l = chain[found];
+        int index = findLine(l, addr);
+        if (found > 0 && l->cfg->policy == EXCLUSIVE)
+        {
+            dirty |= l->state[index] & LINE_DIRTY;  // moves up with the line
+            l->state[index] = 0;
+        }
+        else
+        {
+            touchLine(l, index);
+            if (found == 0)
+                l->state[index] |= dirty;
+        }
+    }
+
+    // Fill from the level above the one that had the line, up to L1.  Exclusive
+    // levels are skipped, they only get lines from evictions.
+    for (int i = found - 1; i >= 0; i--)
+    {
+        if (i > 0 && chain[i]->cfg->policy == EXCLUSIVE)
+            continue;
+        fillLevel(p, chain, n, i, addr, i == 0 ? dirty : 0);
+    }
+
+    return latency;
+}
+
+// latency of filling through the private levels, after data from the bus
+static int privateLatency(void)
+{
+    int latency = 0;
+    for (int i = 0; i < privateLevels; i++)
+        latency += configs[i].latency;
+    return latency;
+}
+
+typedef struct _pendingRequest {
+    int64_t tag;
+    int64_t addr;
+    int processorNum;
+    int isRead;
+    int countDown;
+    void (*callback)(int, int64_t);
+    struct _pendingRequest* next;
+} pendingRequest;
+
+pendingRequest* readyReq = NULL;  // counting down to their callback
+pendingRequest* pendReq = NULL;   // waiting for the coherence component
+pendingRequest* retryReq = NULL;  // made while their line was in a transition
+
+// INVALIDATE drops the block from the processor's private levels,
+//   DATA_RECV completes a request waiting on the bus.  A level with larger
+//   blocks than L1 drops its whole block, so the other L1 blocks in it that
+//   the processor no longer has are given back to the coherence component.
+void coherCallback(int type, int processorNum, int64_t addr)
+{
+    assert(processorNum < processorCount);
+
+    if (type == INVALIDATE)
+    {
+        uint8_t dirty = 0;  // the coherence component moves the data
+        int b = configs[0].b;
+        for (int i = 0; i < privateLevels; i++)
+        {
+            if (!removeBlock(privateLevel(processorNum, i), addr, configs[0].b,
+                             &dirty))
+                continue;
+            if (configs[i].b > b)
+                b = configs[i].b;
+
+            // an inclusive level keeps the levels above inside it
+            if (i > 0 && configs[i].policy == INCLUSIVE)
+            {
+                for (int j = 0; j < i; j++)
+                    removeBlock(privateLevel(processorNum, j), addr,
+                                configs[i].b, &dirty);
+            }
+        }
+
+        // addr's own block is the one the coherence component is invalidating
+        if (b > configs[0].b)
+            released(processorNum, addr, b, addr);
+        return;
+    }
+    if (type != DATA_RECV)
+        return;
+
+    // The oldest request for the block is the one that started the
+    // transition.  The others got no permission and started nothing, they
+    // ask again on the next tick.
+    pendingRequest** prev = &pendReq;
+    pendingRequest* oldest = NULL;
+    for (pendingRequest* pr = pendReq; pr != NULL; pr = *prev)
+    {
+        if (pr->processorNum != processorNum || pr->addr != addr)
+        {
+            prev = &pr->next;
+            continue;
+        }
+
+        *prev = pr->next;
+        if (oldest != NULL)
+        {
+            oldest->next = retryReq;
+            retryReq = oldest;
+        }
+        oldest = pr;
+    }
+    assert(oldest != NULL);
+
+    // countDown still has the latency lookup found for it
+    if (oldest->countDown < privateLatency())
+        oldest->countDown = privateLatency();
+    oldest->next = readyReq;
+    readyReq = oldest;
+}
+
+// pr counts down to its callback if it has permission, otherwise it waits
+//   for the coherence component
+static void askPermission(pendingRequest* pr)
+{
+    if (coherComp->permReq(pr->isRead, pr->addr, pr->processorNum) == 1)
+    {
+        pr->next = readyReq;
+        readyReq = pr;
+    }
+    else
+    {
+        pr->next = pendReq;
+        pendReq = pr;
+    }
+}
+
+void memoryRequest(trace_op* op, int processorNum, int64_t tag,
+                   void (*callback)(int, int64_t))
+{
+    assert(op != NULL);
+    assert(callback != NULL);
+
+    // Requests do not cross L1 blocks, permissions are kept per L1 block
+    uint64_t addr = op->memAddress >> configs[0].b << configs[0].b;
+    int store = (op->op == MEM_STORE);
+    coherComp->noteAccess(!store, op->memAddress, op->size, 1 << configs[0].b,
+                          processorNum);
+
+    // Functional warmup resolves the permissions immediately
+    if (CADSS_FUNCTIONAL)
+    {
+        uint8_t perm = coherComp->permReq(!store, addr, processorNum);
+        lookup(processorNum, op->memAddress, store);
+        assert(perm == 1);
+        callback(processorNum, tag);
+        return;
+    }
+
+    pendingRequest* pr = malloc(sizeof(pendingRequest));
+    pr->tag = tag;
+    pr->addr = addr;
+    pr->callback = callback;
+    pr->processorNum = processorNum;
+    pr->isRead = !store;
+    askPermission(pr);
+    pr->countDown = lookup(processorNum, op->memAddress, store);
+}
+
+int tick()
+{
+    coherComp->si.tick();
+
+    // Callbacks may make new requests, which go on a fresh list.  The ones
+    // still counting down are put back after them.
+    pendingRequest* pr = readyReq;
+    pendingRequest* waiting = NULL;
+    pendingRequest** waitingTail = &waiting;
+    readyReq = NULL;
+    while (pr != NULL)
+    {
+        pendingRequest* next = pr->next;
+        if (--pr->countDown <= 0)
+        {
+            pr->callback(pr->processorNum, pr->tag);
+            free(pr);
+        }
+        else
+        {
+            *waitingTail = pr;
+            waitingTail = &pr->next;
+        }
+        pr = next;
+    }
+    *waitingTail = NULL;
+
+    pendingRequest** tail = &readyReq;
+    while (*tail != NULL)
+        tail = &(*tail)->next;
+    *tail = waiting;
+
+    // A block evicted while its request waited is looked up again
+    pr = retryReq;
+    retryReq = NULL;
+    while (pr != NULL)
+    {
+        pendingRequest* next = pr->next;
+        if (!heldPrivately(pr->processorNum, pr->addr))
+            pr->countDown = lookup(pr->processorNum, pr->addr, !pr->isRead);
+        askPermission(pr);
+        pr = next;
+    }
+
+    return 1;
+}
+
+int finish(int outFd)
+{
+    char buf[160];
+    for (int i = 0; i < privateLevels + hasShared; i++)
+    {
+        level_stats* st = &levelStats[i];
+        int n = snprintf(buf, sizeof(buf),
+                         "%s hits:%lu misses:%lu evictions:%lu writebacks:%lu "
+                         "back-invalidations:%lu\n",
+                         configs[i].name, st->hits, st->misses, st->evictions,
+                         st->writebacks, st->backInvalidations);
+        (void)!write(outFd, buf, n);
+    }
+
+    return coherComp->si.finish(outFd);
+}
+
+int destroy(void)
+{
+    for (int p = 0; p < processorCount; p++)
+    {
+        for (int i = 0; i < privateLevels; i++)
+            freeLevel(privateLevel(p, i));
+    }
+    free(privates);
+    if (hasShared)
+        freeLevel(&shared);
+    free(self);
+
+    return 0;
+}
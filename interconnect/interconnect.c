@@ -1,8 +1,12 @@
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <memory.h>
 #include <interconnect.h>
+#include "snoopfilter.h"
 
 typedef enum _bus_req_state
 {
@@ -22,16 +26,55 @@ typedef struct _bus_req {
     uint8_t shared;
     uint8_t data;
     uint8_t dataAvail;
+    int countDown; // the split-transaction bus times each request itself
+    int ackCountDown; // a directory's forwards, until they are answered
     struct _bus_req* next;
 } bus_req;
 
+// Each processor's requests wait in a FIFO with a tail pointer and a size
+typedef struct _bus_queue {
+    bus_req* head;
+    bus_req* tail;
+    int size;
+} bus_queue;
+
 bus_req* pendingRequest = NULL;
-bus_req** queuedRequests;
+bus_queue* queuedRequests;
+int queuedCount = 0; // requests in every queue, arbitration skips when 0
 interconn* self;
 coher* coherComp;
 memory* memComp;
 
+// Set when a directory decides who sees each request.  The directory is at
+// memory, and sending a request on to the processors it names takes another
+// CACHE_DELAY bus transaction: a cache-to-cache transfer starts after it,
+// and memory's reply waits for the forwarded caches to acknowledge.
+int (*snoopTargets)(bus_req_type brt, uint64_t addr, int procNum,
+                    int* procs) = NULL;
+int* targetProcs = NULL;
+
+// Split-transaction bus, -o <transactions>.  One request at a time holds
+// the request bus for its address phase; after that it waits for its data
+// as one of up to maxOutstanding transactions, and the response bus returns
+// one transaction's data per tick.  A request waits in its queue while an
+// earlier transaction to the same line is outstanding.
+int maxOutstanding = 0; // 0 for the atomic bus
+bus_req** outstanding = NULL; // oldest first
+int outstandingCount = 0;
+bus_req* addressPhase = NULL;
+bus_req* snooping = NULL; // the request the snoopers are answering
+uint64_t transactions = 0;
+uint64_t lineConflicts = 0;
+int peakOutstanding = 0;
+
+// Optional snoop filter, -f <set bits> -a <ways>
+int filterOn = 0;
+uint64_t snoops = 0;
+uint64_t filteredSnoops = 0;
+uint64_t backInvalidations = 0;
+
 int CADSS_VERBOSE = 0;
+int CADSS_FUNCTIONAL = 0;
 int processorCount = 1;
 
 static const char* req_state_map[] = {
@@ -45,50 +88,87 @@ static const char* req_state_map[] = {
 
 static const char* req_type_map[]
     = {[NO_REQ] = "None", [BUSRD] = "BusRd",   [BUSWR] = "BusRdX",
-       [DATA] = "Data",   [SHARED] = "Shared", [MEMORY] = "Memory"};
+       [DATA] = "Data",   [SHARED] = "Shared", [MEMORY] = "Memory",
+       [WRITEBACK] = "Writeback"};
 
 const int CACHE_DELAY = 10;
 const int CACHE_TRANSFER = 10;
 
 void registerCoher(coher* cc);
+void registerSnoopTargets(int (*targets)(bus_req_type, uint64_t, int, int*));
 void busReq(bus_req_type brt, uint64_t addr, int procNum);
 int busReqCacheTransfer(uint64_t addr, int procNum);
 void printInterconnState(void);
-void interconnNotifyState(void);
+void interconnNotifyState(bus_req* br);
 
-// Helper methods for per-processor request queues.
-static void enqBusRequest(bus_req* pr, int procNum)
-{
-    bus_req* iter;
+//
+// Requests come from slabs and go back to a free list, rather than a calloc
+//   and free for every bus transaction.
+//
+#define SLAB_REQUESTS 256
 
-    // No items in the queue.
-    if (!queuedRequests[procNum])
-    {
-        queuedRequests[procNum] = pr;
-        return;
-    }
+typedef struct _req_slab {
+    struct _req_slab* next;
+    bus_req reqs[SLAB_REQUESTS];
+} req_slab;
+
+req_slab* slabs = NULL;
+bus_req* freeReq = NULL;
 
-    // Add request to the end of the queue.
-    iter = queuedRequests[procNum];
-    while (iter->next)
+static bus_req* allocBusRequest(void)
+{
+    if (freeReq == NULL)
     {
-        iter = iter->next;
+        req_slab* slab = malloc(sizeof(req_slab));
+        slab->next = slabs;
+        slabs = slab;
+        for (int i = 0; i < SLAB_REQUESTS; i++)
+        {
+            slab->reqs[i].next = freeReq;
+            freeReq = &slab->reqs[i];
+        }
     }
 
+    bus_req* br = freeReq;
+    freeReq = br->next;
+    *br = (bus_req){0};
+    return br;
+}
+
+static void freeBusRequest(bus_req* br)
+{
+    br->next = freeReq;
+    freeReq = br;
+}
+
+// Helper methods for per-processor request queues.
+static void enqBusRequest(bus_req* pr, int procNum)
+{
+    bus_queue* q = &queuedRequests[procNum];
+
     pr->next = NULL;
-    iter->next = pr;
+    if (q->tail)
+        q->tail->next = pr;
+    else
+        q->head = pr;
+    q->tail = pr;
+    q->size++;
+    queuedCount++;
 }
 
 static bus_req* deqBusRequest(int procNum)
 {
-    bus_req* ret;
-
-    ret = queuedRequests[procNum];
+    bus_queue* q = &queuedRequests[procNum];
+    bus_req* ret = q->head;
 
     // Move the head to the next request (if there is one).
     if (ret)
     {
-        queuedRequests[procNum] = ret->next;
+        q->head = ret->next;
+        if (!q->head)
+            q->tail = NULL;
+        q->size--;
+        queuedCount--;
     }
 
     return ret;
@@ -96,47 +176,70 @@ static bus_req* deqBusRequest(int procNum)
 
 static int busRequestQueueSize(int procNum)
 {
-    int count = 0;
-    bus_req* iter;
-
-    if (!queuedRequests[procNum])
-    {
-        return 0;
-    }
-
-    iter = queuedRequests[procNum];
-    while (iter)
-    {
-        iter = iter->next;
-        count++;
-    }
-
-    return count;
+    return queuedRequests[procNum].size;
 }
 
 interconn* init(inter_sim_args* isa)
 {
     int op;
+    int filterSetBits = -1;
+    int filterWays = 8;
 
-    while ((op = getopt(isa->arg_count, isa->arg_list, "v")) != -1)
+    while ((op = getopt(isa->arg_count, isa->arg_list, "vf:a:o:")) != -1)
     {
         switch (op)
         {
+            // outstanding transactions, for a split-transaction bus
+            case 'o':
+                maxOutstanding = atoi(optarg);
+                break;
+
+            // snoop filter sets, in bits
+            case 'f':
+                filterSetBits = atoi(optarg);
+                break;
+
+            // snoop filter ways
+            case 'a':
+                filterWays = atoi(optarg);
+                break;
+
             default:
                 break;
         }
     }
 
-    queuedRequests = malloc(sizeof(bus_req*) * processorCount);
-    for (int i = 0; i < processorCount; i++)
+    queuedRequests = calloc(processorCount, sizeof(bus_queue));
+
+    if (maxOutstanding < 0)
+    {
+        fprintf(stderr, "Error: invalid outstanding transactions - %d\n",
+                maxOutstanding);
+        return NULL;
+    }
+    if (maxOutstanding > 0)
+    {
+        outstanding = malloc(sizeof(bus_req*) * maxOutstanding);
+    }
+
+    if (filterSetBits >= 0)
     {
-        queuedRequests[i] = NULL;
+        if (filterSetBits > 30 || filterWays < 1)
+        {
+            fprintf(stderr, "Error: invalid snoop filter - %d set bits, %d ways\n",
+                    filterSetBits, filterWays);
+            return NULL;
+        }
+        filterInit(filterSetBits, filterWays, processorCount);
+        filterOn = 1;
+        targetProcs = malloc(sizeof(int) * processorCount);
     }
 
     self = malloc(sizeof(interconn));
     self->busReq = busReq;
     self->registerCoher = registerCoher;
     self->busReqCacheTransfer = busReqCacheTransfer;
+    self->registerSnoopTargets = registerSnoopTargets;
     self->si.tick = tick;
     self->si.finish = finish;
     self->si.destroy = destroy;
@@ -155,8 +258,58 @@ void registerCoher(coher* cc)
     coherComp = cc;
 }
 
+void registerSnoopTargets(int (*targets)(bus_req_type, uint64_t, int, int*))
+{
+    snoopTargets = targets;
+    if (!targetProcs)
+        targetProcs = malloc(sizeof(int) * processorCount);
+}
+
+// Back-invalidates the lines the snoop filter had to evict
+static void recallEvicted(void)
+{
+    uint64_t addr;
+    int procNum;
+
+    while (filterNextRecall(&addr, &procNum))
+    {
+        if (!CADSS_FUNCTIONAL)
+            backInvalidations++;
+        coherComp->recallReq(addr, procNum);
+    }
+}
+
+// The outstanding transaction of procNum for addr, or NULL
+static bus_req* findOutstanding(uint64_t addr, int procNum)
+{
+    for (int i = 0; i < outstandingCount; i++)
+    {
+        if (outstanding[i]->addr == addr && outstanding[i]->procNum == procNum)
+            return outstanding[i];
+    }
+    return NULL;
+}
+
+static int lineOutstanding(uint64_t addr)
+{
+    for (int i = 0; i < outstandingCount; i++)
+    {
+        if (outstanding[i]->addr == addr)
+            return 1;
+    }
+    return 0;
+}
+
 void memReqCallback(int procNum, uint64_t addr)
 {
+    if (maxOutstanding > 0)
+    {
+        bus_req* br = findOutstanding(addr, procNum);
+        if (br)
+            br->dataAvail = 1;
+        return;
+    }
+
     if (!pendingRequest)
     {
         return;
@@ -168,13 +321,151 @@ void memReqCallback(int procNum, uint64_t addr)
     }
 }
 
+// The processors, other than the requester, see br on the bus.  With a
+// directory, only the processors it names, and with a snoop filter only
+// those that may have the line.
+static void snoop(bus_req* br)
+{
+    if (snoopTargets || filterOn)
+    {
+        int n = snoopTargets
+                    ? snoopTargets(br->brt, br->addr, br->procNum, targetProcs)
+                    : filterHolders(br->addr, br->procNum, targetProcs);
+        snoops += n;
+        filteredSnoops += processorCount - 1 - n;
+        if (snoopTargets && n > 0)
+        {
+            br->ackCountDown = CACHE_DELAY;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            coherComp->busReq(br->brt, br->addr, targetProcs[i]);
+        }
+
+        if (filterOn)
+        {
+            // a write leaves the requester the only holder
+            if (br->brt == BUSWR)
+                filterClaim(br->addr, br->procNum);
+            else
+                filterAdd(br->addr, br->procNum);
+            recallEvicted();
+        }
+        return;
+    }
+
+    for (int i = 0; i < processorCount; i++)
+    {
+        if (br->procNum != i)
+        {
+            coherComp->busReq(br->brt, br->addr, i);
+        }
+    }
+}
+
+// The end of br's address phase: memory starts on it and it is snooped,
+// unless it is a writeback, which only goes to memory.  A cache that
+// answers with DATA turns it into a cache-to-cache transfer.
+static void startRequest(bus_req* br)
+{
+    br->countDown = memComp->busReq(br->addr, br->procNum, memReqCallback);
+    br->currentState = WAITING_MEMORY;
+
+    if (br->brt != WRITEBACK)
+    {
+        snooping = br;
+        snoop(br);
+        snooping = NULL;
+    }
+
+    if (br->data == 1)
+    {
+        br->brt = DATA;
+    }
+    else if (br->countDown < br->ackCountDown)
+    {
+        br->countDown = br->ackCountDown;
+    }
+}
+
+// The requester gets its data, as SHARED if another cache kept a copy.  A
+// writeback is done once memory has the data, there is no requester.
+static void respond(bus_req* br)
+{
+    if (br->brt != WRITEBACK)
+    {
+        coherComp->busReq(br->shared ? SHARED : DATA, br->addr, br->procNum);
+    }
+}
+
+// SHARED and DATA answer the request being snooped, any other request
+// waits in its processor's queue for the request bus
+static void busReqSplit(bus_req_type brt, uint64_t addr, int procNum)
+{
+    if (brt == SHARED || brt == DATA)
+    {
+        assert(snooping != NULL && snooping->addr == addr);
+        if (brt == SHARED)
+        {
+            snooping->shared = 1;
+            return;
+        }
+
+        assert(snooping->currentState == WAITING_MEMORY);
+        snooping->data = 1;
+        snooping->currentState = TRANSFERING_CACHE;
+        snooping->countDown = snooping->ackCountDown + CACHE_TRANSFER;
+        return;
+    }
+
+    bus_req* nextReq = allocBusRequest();
+    nextReq->brt = brt;
+    nextReq->currentState = QUEUED;
+    nextReq->addr = addr;
+    nextReq->procNum = procNum;
+
+    enqBusRequest(nextReq, procNum);
+}
+
 void busReq(bus_req_type brt, uint64_t addr, int procNum)
 {
+    // Functional warmup takes no time on the bus, it only fills the filter
+    // or the directory.  Its evictions are recalled on the next tick, outside
+    // the cache's access.
+    if (CADSS_FUNCTIONAL)
+    {
+        if (filterOn && brt == BUSWR)
+            filterClaim(addr, procNum);
+        else if (filterOn)
+            filterAdd(addr, procNum);
+        if (snoopTargets)
+            snoopTargets(brt, addr, procNum, targetProcs);
+        return;
+    }
+
+    // The line left the processor's cache when the writeback was issued, a
+    // request it makes for the line later may be done before this reaches
+    // the bus
+    if (brt == WRITEBACK && filterOn)
+    {
+        filterRemove(addr, procNum);
+    }
+    if (brt == WRITEBACK && snoopTargets)
+    {
+        snoopTargets(brt, addr, procNum, NULL);
+    }
+
+    if (maxOutstanding > 0)
+    {
+        busReqSplit(brt, addr, procNum);
+        return;
+    }
+
     if (pendingRequest == NULL)
     {
         assert(brt != SHARED);
 
-        bus_req* nextReq = calloc(1, sizeof(bus_req));
+        bus_req* nextReq = allocBusRequest();
         nextReq->brt = brt;
         nextReq->currentState = WAITING_CACHE;
         nextReq->addr = addr;
@@ -196,14 +487,15 @@ void busReq(bus_req_type brt, uint64_t addr, int procNum)
         assert(pendingRequest->currentState == WAITING_MEMORY);
         pendingRequest->data = 1;
         pendingRequest->currentState = TRANSFERING_CACHE;
-        countDown = CACHE_TRANSFER;
+        pendingRequest->countDown
+            = pendingRequest->ackCountDown + CACHE_TRANSFER;
         return;
     }
     else
     {
         assert(brt != SHARED);
 
-        bus_req* nextReq = calloc(1, sizeof(bus_req));
+        bus_req* nextReq = allocBusRequest();
         nextReq->brt = brt;
         nextReq->currentState = QUEUED;
         nextReq->addr = addr;
@@ -214,87 +506,156 @@ void busReq(bus_req_type brt, uint64_t addr, int procNum)
     }
 }
 
+static void tickSplit(void)
+{
+    // Data phases: a cache-to-cache transfer takes CACHE_TRANSFER ticks, a
+    // memory fill is ready once memory calls back.  Ready transactions take
+    // the response bus oldest first.
+    int responded = 0;
+    for (int i = 0; i < outstandingCount;)
+    {
+        bus_req* br = outstanding[i];
+        if (br->currentState == WAITING_MEMORY && br->dataAvail)
+        {
+            br->currentState = TRANSFERING_MEMORY;
+        }
+        else if (br->currentState == TRANSFERING_CACHE && br->countDown > 0)
+        {
+            br->countDown--;
+        }
+        if (br->ackCountDown > 0)
+        {
+            br->ackCountDown--;
+        }
+
+        int ready = (br->currentState == TRANSFERING_MEMORY
+                     && br->ackCountDown == 0)
+                    || (br->currentState == TRANSFERING_CACHE
+                        && br->countDown == 0);
+        int needsBus = (br->brt != WRITEBACK);
+        if (!ready || (needsBus && responded))
+        {
+            i++;
+            continue;
+        }
+
+        responded |= needsBus;
+        respond(br);
+
+        // The filter may have evicted the line while its data was on the
+        // way; no other request for it could have been snooped since
+        if (filterOn && needsBus)
+        {
+            filterAdd(br->addr, br->procNum);
+            recallEvicted();
+        }
+
+        interconnNotifyState(br);
+        outstandingCount--;
+        memmove(&outstanding[i], &outstanding[i + 1],
+                sizeof(bus_req*) * (outstandingCount - i));
+        freeBusRequest(br);
+    }
+
+    // The address phase of one request at a time
+    if (addressPhase != NULL)
+    {
+        if (--addressPhase->countDown == 0)
+        {
+            bus_req* br = addressPhase;
+            addressPhase = NULL;
+            outstanding[outstandingCount++] = br;
+            if (outstandingCount > peakOutstanding)
+                peakOutstanding = outstandingCount;
+            transactions++;
+            startRequest(br);
+        }
+    }
+    else if (queuedCount > 0 && outstandingCount < maxOutstanding)
+    {
+        for (int i = 0; i < processorCount; i++)
+        {
+            int pos = (i + lastProc) % processorCount;
+            bus_req* head = queuedRequests[pos].head;
+            if (head == NULL)
+                continue;
+            if (lineOutstanding(head->addr))
+            {
+                lineConflicts++;
+                continue;
+            }
+
+            addressPhase = deqBusRequest(pos);
+            addressPhase->currentState = WAITING_CACHE;
+            addressPhase->countDown = CACHE_DELAY;
+
+            lastProc = (pos + 1) % processorCount;
+            break;
+        }
+    }
+}
+
 int tick()
 {
     memComp->si.tick();
 
+    if (filterOn)
+    {
+        recallEvicted();
+    }
+
     if (self->dbgEnv.cadssDbgWatchedComp && !self->dbgEnv.cadssDbgNotifyState)
     {
         printInterconnState();
     }
 
+    if (maxOutstanding > 0)
+    {
+        tickSplit();
+        return 0;
+    }
+
     if (countDown > 0)
     {
         assert(pendingRequest != NULL);
         countDown--;
+        if (pendingRequest->ackCountDown > 0)
+        {
+            pendingRequest->ackCountDown--;
+        }
 
         // If the count-down has elapsed (or there hasn't been a
         // cache-to-cache transfer, the memory will respond with
-        // the data.
+        // the data, once the forwarded caches have acknowledged.
         if (pendingRequest->dataAvail)
         {
             pendingRequest->currentState = TRANSFERING_MEMORY;
-            countDown = 0;
+            countDown = pendingRequest->ackCountDown;
         }
 
         if (countDown == 0)
         {
             if (pendingRequest->currentState == WAITING_CACHE)
             {
-                // Make a request to memory.
-                countDown
-                    = memComp->busReq(pendingRequest->addr,
-                                      pendingRequest->procNum, memReqCallback);
-
-                pendingRequest->currentState = WAITING_MEMORY;
-
-                // The processors will snoop for this request as well.
-                for (int i = 0; i < processorCount; i++)
-                {
-                    if (pendingRequest->procNum != i)
-                    {
-                        coherComp->busReq(pendingRequest->brt,
-                                          pendingRequest->addr, i);
-                    }
-                }
-
-                if (pendingRequest->data == 1)
-                {
-                    pendingRequest->brt = DATA;
-                }
-            }
-            else if (pendingRequest->currentState == TRANSFERING_MEMORY)
-            {
-                bus_req_type brt
-                    = (pendingRequest->shared == 1) ? SHARED : DATA;
-                coherComp->busReq(brt, pendingRequest->addr,
-                                  pendingRequest->procNum);
-
-                interconnNotifyState();
-                free(pendingRequest);
-                pendingRequest = NULL;
+                startRequest(pendingRequest);
+                countDown = pendingRequest->countDown;
             }
-            else if (pendingRequest->currentState == TRANSFERING_CACHE)
+            else
             {
-                bus_req_type brt = pendingRequest->brt;
-                if (pendingRequest->shared == 1)
-                    brt = SHARED;
-
-                coherComp->busReq(brt, pendingRequest->addr,
-                                  pendingRequest->procNum);
+                respond(pendingRequest);
 
-                interconnNotifyState();
-                free(pendingRequest);
+                interconnNotifyState(pendingRequest);
+                freeBusRequest(pendingRequest);
                 pendingRequest = NULL;
             }
         }
     }
-    else if (countDown == 0)
+    else if (countDown == 0 && queuedCount > 0)
     {
         for (int i = 0; i < processorCount; i++)
         {
             int pos = (i + lastProc) % processorCount;
-            if (queuedRequests[pos] != NULL)
+            if (queuedRequests[pos].head != NULL)
             {
                 pendingRequest = deqBusRequest(pos);
                 countDown = CACHE_DELAY;
@@ -311,6 +672,26 @@ int tick()
 
 void printInterconnState(void)
 {
+    if (maxOutstanding > 0)
+    {
+        printf("--- Interconnect Debug State (Processors: %d) ---\n"
+               "  Outstanding Requests: %d of %d\n",
+               processorCount, outstandingCount, maxOutstanding);
+        for (int i = 0; i < outstandingCount; i++)
+        {
+            bus_req* br = outstanding[i];
+            printf("       - Processor[%02d]: 0x%016lx %s %s\n", br->procNum,
+                   br->addr, req_type_map[br->brt],
+                   req_state_map[br->currentState]);
+        }
+        printf("    Request Queue Size: \n");
+        for (int p = 0; p < processorCount; p++)
+        {
+            printf("       - Processor[%02d]: %d\n", p, busRequestQueueSize(p));
+        }
+        return;
+    }
+
     if (!pendingRequest)
     {
         return;
@@ -338,9 +719,10 @@ void printInterconnState(void)
     }
 }
 
-void interconnNotifyState(void)
+// br has just completed, on either bus
+void interconnNotifyState(bus_req* br)
 {
-    if (!pendingRequest)
+    if (!br)
         return;
 
     if (self->dbgEnv.cadssDbgExternBreak)
@@ -361,6 +743,12 @@ void interconnNotifyState(void)
 // was satisfied by a cache-to-cache transfer.
 int busReqCacheTransfer(uint64_t addr, int procNum)
 {
+    if (maxOutstanding > 0)
+    {
+        bus_req* br = findOutstanding(addr, procNum);
+        return br && br->currentState == TRANSFERING_CACHE;
+    }
+
     assert(pendingRequest);
 
     if (addr == pendingRequest->addr && procNum == pendingRequest->procNum)
@@ -371,13 +759,41 @@ int busReqCacheTransfer(uint64_t addr, int procNum)
 
 int finish(int outFd)
 {
+    if (maxOutstanding > 0)
+    {
+        char buf[128];
+        int n = snprintf(buf, sizeof(buf),
+                         "split bus transactions:%lu peak outstanding:%d "
+                         "line conflicts:%lu\n",
+                         transactions, peakOutstanding, lineConflicts);
+        (void)!write(outFd, buf, n);
+    }
+    if (filterOn)
+    {
+        char buf[128];
+        int n = snprintf(buf, sizeof(buf),
+                         "snoop filter snoops:%lu filtered:%lu "
+                         "back-invalidations:%lu\n",
+                         snoops, filteredSnoops, backInvalidations);
+        (void)!write(outFd, buf, n);
+    }
     memComp->si.finish(outFd);
     return 0;
 }
 
 int destroy(void)
 {
-    // TODO
+    while (slabs != NULL)
+    {
+        req_slab* slab = slabs;
+        slabs = slab->next;
+        free(slab);
+    }
+    free(queuedRequests);
+    free(outstanding);
+    free(targetProcs);
+    if (filterOn)
+        filterDestroy();
     memComp->si.destroy();
     return 0;
 }
@@ -0,0 +1,180 @@
+#include "snoopfilter.h"
+#include <stdlib.h>
+
+//
+// A set-associative tag store of the lines that some processor may hold,
+//   each entry with a bit per processor.  A bit is set when the processor's
+//   request for the line goes out and cleared when it writes the line back,
+//   or when another processor's write invalidates its copy; lines dropped
+//   clean by a cache keep their bit, which only costs a snoop.
+//   A line missing from the filter is held by no one, so the filter has to
+//   stay inclusive: evicting an entry (LRU within its set) queues its
+//   holders to be back-invalidated.
+//
+
+static int setBits = 0;
+static int ways = 0;
+static int words = 0; // holder words per entry
+
+static uint64_t* tags = NULL; // line address + 1, 0 when the way is empty
+static uint64_t* lastUse = NULL;
+static uint64_t* holders = NULL;
+static uint64_t useClock = 0;
+
+typedef struct _recall {
+    uint64_t addr;
+    int procNum;
+} recall;
+
+static recall* recalls = NULL;
+static int recallCount = 0;
+static int recallSize = 0;
+
+static inline uint64_t* holdersOf(long e)
+{
+    return &holders[e * words];
+}
+
+static inline long firstWay(uint64_t addr)
+{
+    if (setBits == 0)
+        return 0;
+    return (long)((addr * 0x9E3779B97F4A7C15UL) >> (64 - setBits)) * ways;
+}
+
+// The entry for addr, or -1
+static long findEntry(uint64_t addr)
+{
+    long first = firstWay(addr);
+    for (long e = first; e < first + ways; e++)
+    {
+        if (tags[e] == addr + 1)
+            return e;
+    }
+    return -1;
+}
+
+static void queueRecall(uint64_t addr, int procNum)
+{
+    if (recallCount == recallSize)
+    {
+        recallSize = recallSize ? 2 * recallSize : 64;
+        recalls = realloc(recalls, sizeof(recall) * recallSize);
+    }
+    recalls[recallCount++] = (recall){addr, procNum};
+}
+
+void filterInit(int sets, int assoc, int processors)
+{
+    setBits = sets;
+    ways = assoc;
+    words = (processors + 63) / 64;
+
+    long entries = (long)ways << setBits;
+    tags = calloc(entries, sizeof(uint64_t));
+    lastUse = calloc(entries, sizeof(uint64_t));
+    holders = calloc(entries * words, sizeof(uint64_t));
+}
+
+int filterHolders(uint64_t addr, int procNum, int* procs)
+{
+    long e = findEntry(addr);
+    int n = 0;
+
+    if (e < 0)
+        return 0;
+    lastUse[e] = ++useClock;
+
+    uint64_t* h = holdersOf(e);
+    for (int w = 0; w < words; w++)
+    {
+        for (uint64_t bits = h[w]; bits != 0; bits &= bits - 1)
+        {
+            int p = w * 64 + __builtin_ctzll(bits);
+            if (p != procNum)
+                procs[n++] = p;
+        }
+    }
+    return n;
+}
+
+void filterAdd(uint64_t addr, int procNum)
+{
+    long e = findEntry(addr);
+
+    if (e < 0)
+    {
+        // an empty way, else the least recently used one
+        long first = firstWay(addr);
+        e = first;
+        for (long i = first + 1; i < first + ways && tags[e] != 0; i++)
+        {
+            if (tags[i] == 0 || lastUse[i] < lastUse[e])
+                e = i;
+        }
+
+        uint64_t* h = holdersOf(e);
+        for (int w = 0; w < words; w++)
+        {
+            for (uint64_t bits = h[w]; bits != 0; bits &= bits - 1)
+            {
+                queueRecall(tags[e] - 1, w * 64 + __builtin_ctzll(bits));
+            }
+            h[w] = 0;
+        }
+        tags[e] = addr + 1;
+    }
+
+    holdersOf(e)[procNum / 64] |= 1UL << (procNum % 64);
+    lastUse[e] = ++useClock;
+}
+
+void filterClaim(uint64_t addr, int procNum)
+{
+    long e = findEntry(addr);
+    if (e >= 0)
+    {
+        uint64_t* h = holdersOf(e);
+        for (int w = 0; w < words; w++)
+            h[w] = 0;
+    }
+    filterAdd(addr, procNum);
+}
+
+void filterRemove(uint64_t addr, int procNum)
+{
+    long e = findEntry(addr);
+    if (e < 0)
+        return;
+
+    uint64_t* h = holdersOf(e);
+    h[procNum / 64] &= ~(1UL << (procNum % 64));
+    for (int w = 0; w < words; w++)
+    {
+        if (h[w] != 0)
+            return;
+    }
+    tags[e] = 0;
+}
+
+int filterNextRecall(uint64_t* addr, int* procNum)
+{
+    if (recallCount == 0)
+        return 0;
+
+    recallCount--;
+    *addr = recalls[recallCount].addr;
+    *procNum = recalls[recallCount].procNum;
+    return 1;
+}
+
+void filterDestroy(void)
+{
+    free(tags);
+    free(lastUse);
+    free(holders);
+    free(recalls);
+    tags = lastUse = holders = NULL;
+    recalls = NULL;
+    recallCount = recallSize = 0;
+}
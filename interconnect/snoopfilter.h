@@ -0,0 +1,30 @@
+#ifndef SNOOPFILTER_H
+#define SNOOPFILTER_H
+
+#include <stdint.h>
+
+//
+// Inclusive snoop filter, see snoopfilter.c
+//
+void filterInit(int setBits, int ways, int processors);
+
+// Fills procs with the processors other than procNum that may hold addr
+int filterHolders(uint64_t addr, int procNum, int* procs);
+
+// procNum may hold addr from now on.  Making room can evict another line,
+//   whose holders are then queued for back-invalidation.
+void filterAdd(uint64_t addr, int procNum);
+
+// procNum is the only processor that may hold addr from now on, as after
+//   its write invalidated the others
+void filterClaim(uint64_t addr, int procNum);
+
+// procNum no longer holds addr
+void filterRemove(uint64_t addr, int procNum);
+
+// Pops the next queued back-invalidation, returns 0 when there is none
+int filterNextRecall(uint64_t* addr, int* procNum);
+
+void filterDestroy(void);
+
+#endif
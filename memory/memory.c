@@ -9,9 +9,12 @@ void registerInterconnect(interconn* interconnect);
 int busReq(uint64_t addr, int procNum, void (*callback)(int, uint64_t));
 
 memory* self = NULL;
-memReq* pendingRequest = NULL;
 interconn* interComp;
-int countDown = 0;
+
+// Requests in flight, oldest first.  The atomic bus has at most one, a
+//   split-transaction bus one per outstanding transaction.
+memReq* pendingRequests = NULL;
+memReq** pendingTail = &pendingRequests;
 
 // This is the same as "BUS_TIME".
 const int DRAM_FETCH_TICKS = 90;
@@ -28,7 +31,6 @@ memory* init(memory_sim_args* args)
     self->si.tick = tick;
     self->si.finish = finish;
     self->si.destroy = destroy;
-    pendingRequest = NULL;
 
     return self;
 }
@@ -43,53 +45,61 @@ void registerInterconnect(interconn* interconnect)
 
 int busReq(uint64_t addr, int procNum, void (*callback)(int, uint64_t))
 {
-    assert(pendingRequest == NULL);
-
-    pendingRequest = calloc(1, sizeof(memReq));
-    pendingRequest->addr = addr;
-    pendingRequest->procNum = procNum;
-    pendingRequest->squelch = 0;
-    pendingRequest->callback = callback;
+    memReq* req = calloc(1, sizeof(memReq));
+    req->addr = addr;
+    req->procNum = procNum;
+    req->squelch = 0;
+    req->callback = callback;
+    req->countDown = DRAM_FETCH_TICKS;
 
-    countDown = DRAM_FETCH_TICKS;
+    *pendingTail = req;
+    pendingTail = &req->next;
 
-    return countDown;
+    return req->countDown;
 }
 
 int tick()
 {
-    if (countDown > 0)
+    int pending = 0;
+
+    for (memReq** prev = &pendingRequests; *prev != NULL;)
     {
-        assert(pendingRequest);
+        memReq* req = *prev;
 
         // Check if one of the caches responded to the request that we are
         // processing. If that's the case, we "squelch" the response and
         // make ourselves available for the next request.
-        if (interComp->busReqCacheTransfer(pendingRequest->addr,
-                                           pendingRequest->procNum))
+        if (interComp->busReqCacheTransfer(req->addr, req->procNum))
         {
-            pendingRequest->squelch = 1;
-            countDown = 0;
-            goto done;
+            req->squelch = 1;
+            req->countDown = 0;
+        }
+        else
+        {
+            req->countDown--;
         }
 
-        countDown--;
-    }
+        if (req->countDown > 0)
+        {
+            prev = &req->next;
+            pending++;
+            continue;
+        }
 
-done:
-    if (pendingRequest && countDown == 0)
-    {
-        if (!pendingRequest->squelch)
+        if (!req->squelch)
         {
-            pendingRequest->callback(pendingRequest->procNum,
-                                     pendingRequest->addr);
+            req->callback(req->procNum, req->addr);
         }
 
-        free(pendingRequest);
-        pendingRequest = NULL;
+        *prev = req->next;
+        if (*prev == NULL)
+        {
+            pendingTail = prev;
+        }
+        free(req);
     }
 
-    return countDown;
+    return pending;
 }
 
 int finish(int outFd)
@@ -100,7 +110,12 @@ int finish(int outFd)
 int destroy(void)
 {
     free(self);
-    free(pendingRequest);
+    while (pendingRequests != NULL)
+    {
+        memReq* req = pendingRequests;
+        pendingRequests = req->next;
+        free(req);
+    }
 
     return 0;
 }
@@ -6,7 +6,9 @@ typedef struct _memReq {
     int procNum;
     uint64_t addr;
     int squelch;
+    int countDown;
     void (*callback)(int, uint64_t);
+    struct _memReq* next;
 } memReq;
 
 #endif // MEMORY_INTERNAL_H
@@ -0,0 +1,618 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory.h>
+#include <interconnect.h>
+#include "topology.h"
+
+//
+// An interconnect where processor n sits at node n of a mesh, ring or
+//   crossbar (see topology.c) rather than on a bus, selected with -i noc.
+//
+// Every line has a home node, where its memory is and where its requests
+//   are ordered.  A request travels to the home and waits there while an
+//   earlier request for the same line is in flight; requests for other
+//   lines go on at once.  Once ordered it is snooped and memory starts on
+//   it.  A cache that answers with DATA is sent a forward by the home and
+//   sends the line straight to the requester, otherwise the home sends the
+//   line once memory has it.  A writeback carries the line to the home and
+//   is done when memory has it.
+//
+// The snoop is a forward from the home to every other processor, or with a
+//   directory to each processor it names.  On a write each of them that
+//   does not send the line acknowledges its invalidation to the requester,
+//   and the requester is done once it has the line and every
+//   acknowledgement.  The snoop takes effect at the home in the tick the
+//   request is ordered; only its messages' timing waits on the links.
+//
+
+typedef enum _noc_req_state
+{
+    TO_HOME,
+    WAITING_LINE,
+    WAITING_MEMORY,
+    MEMORY_DONE,
+    TRANSFERING_CACHE,
+    TRANSFERING_MEMORY
+} noc_req_state;
+
+typedef struct _noc_req {
+    bus_req_type brt;
+    noc_req_state currentState;
+    uint64_t addr;
+    int procNum;
+    int home;
+    uint8_t shared;
+    uint64_t issued;
+    uint64_t forwardAt; // the home's forward reaches the processor snooped
+    uint64_t acksAt;    // the last acknowledgement reaches the requester
+    uint64_t readyAt; // tick of its next event
+    uint64_t seq;     // orders events in the same tick
+    struct _noc_req* next; // in its home's active or waiting list
+} noc_req;
+
+// The requests ordered at a home and not yet done, and those waiting
+// behind one of them for the same line
+typedef struct _home_node {
+    noc_req* active;
+    noc_req* waitHead;
+    noc_req* waitTail;
+} home_node;
+
+home_node* homes = NULL;
+interconn* self;
+coher* coherComp;
+memory* memComp;
+
+// Set when a directory decides who sees each request
+int (*snoopTargets)(bus_req_type brt, uint64_t addr, int procNum,
+                    int* procs) = NULL;
+int* targetProcs = NULL; // the processors a request is forwarded to
+noc_req* snooping = NULL; // the request the snoopers are answering
+
+// Requests in flight, a min-heap on (readyAt, seq)
+noc_req** events = NULL;
+int eventCount = 0;
+int eventSize = 0;
+uint64_t eventSeq = 0;
+uint64_t now = 0;
+
+int controlBytes = 8;
+int dataBytes = 64;
+
+uint64_t transactions = 0;
+uint64_t cacheTransfers = 0;
+uint64_t forwards = 0;
+uint64_t acks = 0;
+uint64_t lineWaits = 0;
+uint64_t totalLatency = 0;
+uint64_t reads = 0;
+
+int CADSS_VERBOSE = 0;
+int CADSS_FUNCTIONAL = 0;
+int processorCount = 1;
+
+static const char* req_state_map[] = {
+    [TO_HOME] = "To Home",
+    [WAITING_LINE] = "Waiting for Line",
+    [WAITING_MEMORY] = "Waiting for Memory",
+    [MEMORY_DONE] = "Memory Done",
+    [TRANSFERING_CACHE] = "Cache-to-Cache Transfer",
+    [TRANSFERING_MEMORY] = "Memory Transfer",
+};
+
+static const char* req_type_map[]
+    = {[NO_REQ] = "None", [BUSRD] = "BusRd",   [BUSWR] = "BusRdX",
+       [DATA] = "Data",   [SHARED] = "Shared", [MEMORY] = "Memory",
+       [WRITEBACK] = "Writeback"};
+
+void registerCoher(coher* cc);
+void registerSnoopTargets(int (*targets)(bus_req_type, uint64_t, int, int*));
+void busReq(bus_req_type brt, uint64_t addr, int procNum);
+int busReqCacheTransfer(uint64_t addr, int procNum);
+void printInterconnState(void);
+
+//
+// Requests come from slabs and go back to a free list, as on the bus.
+//
+#define SLAB_REQUESTS 256
+
+typedef struct _req_slab {
+    struct _req_slab* next;
+    noc_req reqs[SLAB_REQUESTS];
+} req_slab;
+
+req_slab* slabs = NULL;
+noc_req* freeReq = NULL;
+
+static noc_req* allocNocRequest(void)
+{
+    if (freeReq == NULL)
+    {
+        req_slab* slab = malloc(sizeof(req_slab));
+        slab->next = slabs;
+        slabs = slab;
+        for (int i = 0; i < SLAB_REQUESTS; i++)
+        {
+            slab->reqs[i].next = freeReq;
+            freeReq = &slab->reqs[i];
+        }
+    }
+
+    noc_req* nr = freeReq;
+    freeReq = nr->next;
+    *nr = (noc_req){0};
+    return nr;
+}
+
+static void freeNocRequest(noc_req* nr)
+{
+    nr->next = freeReq;
+    freeReq = nr;
+}
+
+static int eventBefore(const noc_req* a, const noc_req* b)
+{
+    return a->readyAt < b->readyAt
+           || (a->readyAt == b->readyAt && a->seq < b->seq);
+}
+
+// nr's next event is at tick t
+static void schedule(noc_req* nr, uint64_t t)
+{
+    if (eventCount == eventSize)
+    {
+        eventSize = eventSize ? eventSize * 2 : 64;
+        events = realloc(events, sizeof(noc_req*) * eventSize);
+    }
+
+    nr->readyAt = t;
+    nr->seq = eventSeq++;
+
+    int i = eventCount++;
+    while (i > 0 && eventBefore(nr, events[(i - 1) / 2]))
+    {
+        events[i] = events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    events[i] = nr;
+}
+
+static noc_req* nextEvent(void)
+{
+    noc_req* top = events[0];
+    noc_req* last = events[--eventCount];
+    int i = 0;
+
+    for (;;)
+    {
+        int c = 2 * i + 1;
+        if (c >= eventCount)
+            break;
+        if (c + 1 < eventCount && eventBefore(events[c + 1], events[c]))
+            c++;
+        if (!eventBefore(events[c], last))
+            break;
+        events[i] = events[c];
+        i = c;
+    }
+    events[i] = last;
+    return top;
+}
+
+static int homeOf(uint64_t addr)
+{
+    return (addr / dataBytes) % processorCount;
+}
+
+interconn* init(inter_sim_args* isa)
+{
+    int op;
+    topology_kind kind = MESH;
+    link_params params = {.linkLatency = 1,
+                          .linkBytes = 16,
+                          .routerLatency = 1,
+                          .bufferFlits = 8};
+
+    while ((op = getopt(isa->arg_count, isa->arg_list, "t:l:b:r:q:z:")) != -1)
+    {
+        switch (op)
+        {
+            // topology, mesh, ring or crossbar
+            case 't':
+                if (strcmp(optarg, "mesh") == 0)
+                    kind = MESH;
+                else if (strcmp(optarg, "ring") == 0)
+                    kind = RING;
+                else if (strcmp(optarg, "crossbar") == 0)
+                    kind = CROSSBAR;
+                else
+                {
+                    fprintf(stderr, "Error: unknown topology - %s\n", optarg);
+                    return NULL;
+                }
+                break;
+
+            // ticks across a link
+            case 'l':
+                params.linkLatency = atoi(optarg);
+                break;
+
+            // link width in bytes, one flit a tick
+            case 'b':
+                params.linkBytes = atoi(optarg);
+                break;
+
+            // ticks through a router
+            case 'r':
+                params.routerLatency = atoi(optarg);
+                break;
+
+            // router input buffer in flits
+            case 'q':
+                params.bufferFlits = atoi(optarg);
+                break;
+
+            // bytes of a data message, the cache line
+            case 'z':
+                dataBytes = atoi(optarg);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (params.linkLatency < 1 || params.linkBytes < 1
+        || params.routerLatency < 0 || params.bufferFlits < 1)
+    {
+        fprintf(stderr,
+                "Error: invalid links - latency %d, width %d, router %d, "
+                "buffer %d\n",
+                params.linkLatency, params.linkBytes, params.routerLatency,
+                params.bufferFlits);
+        return NULL;
+    }
+    if (dataBytes < 1)
+    {
+        fprintf(stderr, "Error: invalid line size - %d\n", dataBytes);
+        return NULL;
+    }
+
+    topologyInit(kind, processorCount, params);
+    homes = calloc(processorCount, sizeof(home_node));
+    targetProcs = malloc(sizeof(int) * processorCount);
+
+    self = malloc(sizeof(interconn));
+    self->busReq = busReq;
+    self->registerCoher = registerCoher;
+    self->busReqCacheTransfer = busReqCacheTransfer;
+    self->registerSnoopTargets = registerSnoopTargets;
+    self->si.tick = tick;
+    self->si.finish = finish;
+    self->si.destroy = destroy;
+
+    memComp = isa->memory;
+    memComp->registerInterconnect(self);
+
+    return self;
+}
+
+void registerCoher(coher* cc)
+{
+    coherComp = cc;
+}
+
+void registerSnoopTargets(int (*targets)(bus_req_type, uint64_t, int, int*))
+{
+    snoopTargets = targets;
+}
+
+static noc_req* findActive(uint64_t addr, int procNum)
+{
+    for (noc_req* nr = homes[homeOf(addr)].active; nr; nr = nr->next)
+    {
+        if (nr->addr == addr && nr->procNum == procNum)
+            return nr;
+    }
+    return NULL;
+}
+
+static int lineActive(home_node* h, uint64_t addr)
+{
+    for (noc_req* nr = h->active; nr; nr = nr->next)
+    {
+        if (nr->addr == addr)
+            return 1;
+    }
+    return 0;
+}
+
+void memReqCallback(int procNum, uint64_t addr)
+{
+    noc_req* nr = findActive(addr, procNum);
+    if (nr && nr->currentState == WAITING_MEMORY)
+    {
+        nr->currentState = MEMORY_DONE;
+        schedule(nr, now);
+    }
+}
+
+// The processors, other than the requester, see nr, each when the home's
+// forward gets there.  With a directory, only the processors it names.
+static void snoop(noc_req* nr)
+{
+    int n = 0;
+
+    if (snoopTargets)
+    {
+        n = snoopTargets(nr->brt, nr->addr, nr->procNum, targetProcs);
+    }
+    else
+    {
+        for (int i = 0; i < processorCount; i++)
+        {
+            if (nr->procNum != i)
+                targetProcs[n++] = i;
+        }
+    }
+
+    snooping = nr;
+    for (int i = 0; i < n; i++)
+    {
+        int p = targetProcs[i];
+        int hadSupplier = nr->currentState == TRANSFERING_CACHE;
+
+        forwards++;
+        nr->forwardAt = topologySend(nr->home, p, controlBytes, now);
+        coherComp->busReq(nr->brt, nr->addr, p);
+
+        int supplied = !hadSupplier && nr->currentState == TRANSFERING_CACHE;
+        if (nr->brt == BUSWR && !supplied)
+        {
+            uint64_t t
+                = topologySend(p, nr->procNum, controlBytes, nr->forwardAt);
+            if (t > nr->acksAt)
+                nr->acksAt = t;
+            acks++;
+        }
+    }
+    snooping = NULL;
+}
+
+// nr is at its home and no other request for its line is in flight
+static void order(noc_req* nr)
+{
+    home_node* h = &homes[nr->home];
+
+    nr->next = h->active;
+    h->active = nr;
+    nr->currentState = WAITING_MEMORY;
+    memComp->busReq(nr->addr, nr->procNum, memReqCallback);
+    transactions++;
+
+    if (nr->brt != WRITEBACK)
+    {
+        snoop(nr);
+    }
+}
+
+// nr is done, the next request waiting for its line is ordered
+static void complete(noc_req* nr)
+{
+    home_node* h = &homes[nr->home];
+    noc_req** p = &h->active;
+
+    while (*p != nr)
+        p = &(*p)->next;
+    *p = nr->next;
+
+    if (nr->brt != WRITEBACK)
+    {
+        totalLatency += now - nr->issued;
+        reads++;
+    }
+
+    noc_req* prev = NULL;
+    for (noc_req* w = h->waitHead; w; prev = w, w = w->next)
+    {
+        if (w->addr != nr->addr)
+            continue;
+
+        if (prev)
+            prev->next = w->next;
+        else
+            h->waitHead = w->next;
+        if (h->waitTail == w)
+            h->waitTail = prev;
+        order(w);
+        break;
+    }
+
+    freeNocRequest(nr);
+}
+
+static void handleEvent(noc_req* nr)
+{
+    home_node* h = &homes[nr->home];
+
+    switch (nr->currentState)
+    {
+        case TO_HOME:
+            if (!lineActive(h, nr->addr))
+            {
+                order(nr);
+                break;
+            }
+
+            lineWaits++;
+            nr->currentState = WAITING_LINE;
+            nr->next = NULL;
+            if (h->waitTail)
+                h->waitTail->next = nr;
+            else
+                h->waitHead = nr;
+            h->waitTail = nr;
+            break;
+
+        case MEMORY_DONE:
+            if (nr->brt == WRITEBACK)
+            {
+                complete(nr);
+                break;
+            }
+            nr->currentState = TRANSFERING_MEMORY;
+            schedule(nr, topologySend(nr->home, nr->procNum, dataBytes, now));
+            break;
+
+        // The requester gets its data, as SHARED if another cache kept a
+        // copy, once the invalidations are acknowledged
+        case TRANSFERING_CACHE:
+        case TRANSFERING_MEMORY:
+            if (nr->acksAt > now)
+            {
+                schedule(nr, nr->acksAt);
+                break;
+            }
+            coherComp->busReq(nr->shared ? SHARED : DATA, nr->addr,
+                              nr->procNum);
+            complete(nr);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// SHARED and DATA answer the request being snooped, any other request
+// sets off for its line's home
+void busReq(bus_req_type brt, uint64_t addr, int procNum)
+{
+    // Functional warmup takes no time on the network, a directory still
+    // learns who holds what
+    if (CADSS_FUNCTIONAL)
+    {
+        if (snoopTargets)
+            snoopTargets(brt, addr, procNum, targetProcs);
+        return;
+    }
+
+    if (brt == SHARED || brt == DATA)
+    {
+        assert(snooping != NULL && snooping->addr == addr);
+        if (brt == SHARED)
+        {
+            snooping->shared = 1;
+            return;
+        }
+
+        // The supplier sends the line once the home's forward reaches it
+        assert(snooping->currentState == WAITING_MEMORY);
+        snooping->currentState = TRANSFERING_CACHE;
+        cacheTransfers++;
+        schedule(snooping, topologySend(procNum, snooping->procNum, dataBytes,
+                                        snooping->forwardAt));
+        return;
+    }
+
+    // A directory drops the writer when the writeback leaves
+    if (brt == WRITEBACK && snoopTargets)
+    {
+        snoopTargets(brt, addr, procNum, NULL);
+    }
+
+    noc_req* nr = allocNocRequest();
+    nr->brt = brt;
+    nr->currentState = TO_HOME;
+    nr->addr = addr;
+    nr->procNum = procNum;
+    nr->home = homeOf(addr);
+    nr->issued = now;
+
+    int bytes = (brt == WRITEBACK) ? dataBytes : controlBytes;
+    schedule(nr, topologySend(procNum, nr->home, bytes, now));
+}
+
+int tick()
+{
+    now++;
+    memComp->si.tick();
+
+    if (self->dbgEnv.cadssDbgWatchedComp && !self->dbgEnv.cadssDbgNotifyState)
+    {
+        printInterconnState();
+    }
+
+    while (eventCount > 0 && events[0]->readyAt <= now)
+    {
+        handleEvent(nextEvent());
+    }
+
+    return 0;
+}
+
+void printInterconnState(void)
+{
+    printf("--- Interconnect Debug State (Processors: %d) ---\n"
+           "  Tick: %lu, Messages in Flight: %d\n",
+           processorCount, now, eventCount);
+    for (int n = 0; n < processorCount; n++)
+    {
+        for (noc_req* nr = homes[n].active; nr; nr = nr->next)
+        {
+            printf("       - Home[%02d]: Processor[%02d] 0x%016lx %s %s\n", n,
+                   nr->procNum, nr->addr, req_type_map[nr->brt],
+                   req_state_map[nr->currentState]);
+        }
+        for (noc_req* nr = homes[n].waitHead; nr; nr = nr->next)
+        {
+            printf("       - Home[%02d]: Processor[%02d] 0x%016lx %s %s\n", n,
+                   nr->procNum, nr->addr, req_type_map[nr->brt],
+                   req_state_map[nr->currentState]);
+        }
+    }
+}
+
+// Return a non-zero value if the request was satisfied by a cache-to-cache
+// transfer.
+int busReqCacheTransfer(uint64_t addr, int procNum)
+{
+    noc_req* nr = findActive(addr, procNum);
+    return nr && nr->currentState == TRANSFERING_CACHE;
+}
+
+int finish(int outFd)
+{
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf),
+                     "noc transactions:%lu cache transfers:%lu line waits:%lu "
+                     "average latency:%.1f\n",
+                     transactions, cacheTransfers, lineWaits,
+                     reads ? (double)totalLatency / reads : 0.0);
+    (void)!write(outFd, buf, n);
+    n = snprintf(buf, sizeof(buf), "noc %s forwards:%lu acknowledgements:%lu\n",
+                 snoopTargets ? "directory" : "broadcast", forwards, acks);
+    (void)!write(outFd, buf, n);
+    topologyReport(outFd);
+    memComp->si.finish(outFd);
+    return 0;
+}
+
+int destroy(void)
+{
+    while (slabs != NULL)
+    {
+        req_slab* slab = slabs;
+        slabs = slab->next;
+        free(slab);
+    }
+    free(events);
+    free(homes);
+    free(targetProcs);
+    topologyDestroy();
+    memComp->si.destroy();
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "topology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//
+// Node n of a mesh is at (n % width, n / width) on a grid as square as the
+//   node count allows, and messages go along X and then along Y.  A ring
+//   goes whichever way round is shorter, and a crossbar reaches every node
+//   in one hop, through the destination's output port.
+//
+// Each link is free again at some tick.  A message takes its next link once
+//   it is through the router and the link is free, holds it for a tick per
+//   flit, and its tail is over linkLatency ticks after that.  A message that
+//   waits longer at a router than its input buffer covers holds the link it
+//   came in on until it fits, so the wait backs up along the route.
+//
+
+enum
+{
+    EAST,
+    WEST,
+    NORTH,
+    SOUTH,
+    MESH_PORTS
+};
+
+static topology_kind kind = MESH;
+static link_params lp;
+static int nodeCount = 0;
+static int width = 1;
+static int height = 1;
+
+static uint64_t* linkFree = NULL;
+
+static uint64_t messages = 0;
+static uint64_t hops = 0;
+static uint64_t waitTicks = 0;
+
+// The node after at on the way to dst, and the link used to get there
+static int nextHop(int at, int dst, int* link)
+{
+    switch (kind)
+    {
+        case MESH:
+        {
+            int x = at % width, y = at / width;
+            int dx = dst % width, dy = dst / width;
+            if (x != dx)
+            {
+                *link = at * MESH_PORTS + ((x < dx) ? EAST : WEST);
+                return (x < dx) ? at + 1 : at - 1;
+            }
+            *link = at * MESH_PORTS + ((y < dy) ? SOUTH : NORTH);
+            return (y < dy) ? at + width : at - width;
+        }
+
+        case RING:
+        {
+            int clockwise = (dst - at + nodeCount) % nodeCount;
+            if (clockwise <= nodeCount - clockwise)
+            {
+                *link = at * 2;
+                return (at + 1) % nodeCount;
+            }
+            *link = at * 2 + 1;
+            return (at - 1 + nodeCount) % nodeCount;
+        }
+
+        case CROSSBAR:
+        default:
+            *link = dst;
+            return dst;
+    }
+}
+
+void topologyInit(topology_kind k, int nodes, link_params params)
+{
+    int links = nodes;
+
+    kind = k;
+    lp = params;
+    nodeCount = nodes;
+
+    if (kind == MESH)
+    {
+        while (width * width < nodes)
+            width++;
+        height = (nodes + width - 1) / width;
+
+        // The last row may be short, routes still pass where its nodes
+        // would be
+        links = width * height * MESH_PORTS;
+    }
+    else if (kind == RING)
+    {
+        links = nodes * 2;
+    }
+
+    linkFree = calloc(links, sizeof(uint64_t));
+}
+
+uint64_t topologySend(int src, int dst, int bytes, uint64_t t)
+{
+    uint64_t flits = (bytes + lp.linkBytes - 1) / lp.linkBytes;
+    int prev = -1;
+
+    messages++;
+    while (src != dst)
+    {
+        int link;
+        int next = nextHop(src, dst, &link);
+
+        t += lp.routerLatency;
+        uint64_t start = (linkFree[link] > t) ? linkFree[link] : t;
+        waitTicks += start - t;
+        if (prev >= 0 && start - t > (uint64_t)lp.bufferFlits
+            && linkFree[prev] < start - lp.bufferFlits)
+        {
+            linkFree[prev] = start - lp.bufferFlits;
+        }
+
+        linkFree[link] = start + flits;
+        t = start + lp.linkLatency + flits - 1;
+
+        prev = link;
+        src = next;
+        hops++;
+    }
+
+    return t;
+}
+
+void topologyReport(int outFd)
+{
+    char buf[160];
+    int n;
+
+    if (kind == MESH)
+        n = snprintf(buf, sizeof(buf), "noc mesh %dx%d", width, height);
+    else
+        n = snprintf(buf, sizeof(buf), "noc %s %d",
+                     (kind == RING) ? "ring" : "crossbar", nodeCount);
+    n += snprintf(buf + n, sizeof(buf) - n,
+                  " messages:%lu average hops:%.2f link waits:%lu\n",
+                  messages, messages ? (double)hops / messages : 0.0,
+                  waitTicks);
+    (void)!write(outFd, buf, n);
+}
+
+void topologyDestroy(void)
+{
+    free(linkFree);
+    linkFree = NULL;
+}
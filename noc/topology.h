@@ -0,0 +1,32 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdint.h>
+
+typedef enum _topology_kind
+{
+    MESH,
+    RING,
+    CROSSBAR
+} topology_kind;
+
+typedef struct _link_params {
+    int linkLatency;   // ticks for a flit to cross a link
+    int linkBytes;     // bytes a link carries per tick, one flit
+    int routerLatency; // ticks through each router
+    int bufferFlits;   // flits a router input can hold
+} link_params;
+
+//
+// The links between the nodes, see topology.c
+//
+void topologyInit(topology_kind kind, int nodes, link_params params);
+
+// The tick a message of bytes sent from src at tick t is all at dst,
+// reserving every link on the way
+uint64_t topologySend(int src, int dst, int bytes, uint64_t t);
+
+void topologyReport(int outFd);
+void topologyDestroy(void);
+
+#endif
@@ -15,10 +15,13 @@ processor* self = NULL;
 
 int processorCount = 1;
 int CADSS_VERBOSE = 0;
+int CADSS_FUNCTIONAL = 0;
 
-int* pendingMem = NULL;
+int* pendingMem = NULL;      // outstanding memory ops of each core
 int* pendingBranch = NULL;
-int64_t* memOpTag = NULL;
+int64_t* memOpTag = NULL;    // tag of the next memory op of each core
+int maxMemOps = 1;           // outstanding memory ops allowed per core
+int64_t* memOpSlots = NULL;  // maxMemOps tags of each core in flight, or -1
 
 //
 // init
@@ -34,7 +37,7 @@ processor* init(processor_sim_args* psa)
     bs = psa->branch_sim;
 
     // TODO - get argument list from assignment
-    while ((op = getopt(psa->arg_count, psa->arg_list, "f:d:m:j:k:c:")) != -1)
+    while ((op = getopt(psa->arg_count, psa->arg_list, "f:d:m:j:k:c:l:")) != -1)
     {
         switch (op)
         {
@@ -61,12 +64,22 @@ processor* init(processor_sim_args* psa)
             // Number of CDBs
             case 'c':
                 break;
+
+            // Outstanding memory ops per core, needs a non-blocking cache
+            case 'l':
+                maxMemOps = atoi(optarg);
+                if (maxMemOps < 1)
+                    maxMemOps = 1;
+                break;
         }
     }
 
     pendingBranch = calloc(processorCount, sizeof(int));
     pendingMem = calloc(processorCount, sizeof(int));
     memOpTag = calloc(processorCount, sizeof(int64_t));
+    memOpSlots = malloc(sizeof(int64_t) * processorCount * maxMemOps);
+    for (int i = 0; i < processorCount * maxMemOps; i++)
+        memOpSlots[i] = -1;
 
     self = calloc(1, sizeof(processor));
     return self;
@@ -78,24 +91,40 @@ int64_t stallCount = -1;
 
 int64_t makeTag(int procNum, int64_t baseTag)
 {
-    return ((int64_t)procNum) | (baseTag << 8);
+    return ((int64_t)procNum) | (baseTag << CADSS_PROC_BITS);
 }
 
 void memOpCallback(int procNum, int64_t tag)
 {
-    int64_t baseTag = (tag >> 8);
+    int64_t baseTag = (tag >> CADSS_PROC_BITS);
 
     // Is the completed memop one that is pending?
-    if (baseTag == memOpTag[procNum])
-    {
-        memOpTag[procNum]++;
-        pendingMem[procNum] = 0;
-        stallCount = tickCount + STALL_TIME;
-    }
-    else
+    //   With several outstanding ops, they may complete out of order, but
+    //   each completes once.
+    int64_t* slots = memOpSlots + procNum * maxMemOps;
+    for (int i = 0; i < maxMemOps; i++)
     {
-        printf("memopTag: %ld != tag %ld\n", memOpTag[procNum], tag);
+        if (slots[i] == baseTag)
+        {
+            slots[i] = -1;
+            pendingMem[procNum]--;
+            stallCount = tickCount + STALL_TIME;
+            return;
+        }
     }
+
+    printf("memopTag: %ld != tag %ld\n", memOpTag[procNum], tag);
+}
+
+// Records memOpTag[procNum] as in flight, there is a free slot below -l
+static void issueMemOp(int procNum)
+{
+    int64_t* slots = memOpSlots + procNum * maxMemOps;
+    int i = 0;
+
+    while (slots[i] != -1)
+        i++;
+    slots[i] = memOpTag[procNum];
 }
 
 int tick(void)
@@ -110,16 +139,19 @@ int tick(void)
     // Pass along to the branch predictor and cache simulator that time ticked
     bs->si.tick();
     cs->si.tick();
-    tickCount++;
 
-    if (tickCount == stallCount)
+    // Functional warmup is not part of the simulated time
+    if (!CADSS_FUNCTIONAL)
+        tickCount++;
+
+    if (tickCount == stallCount && !CADSS_FUNCTIONAL)
     {
         printf(
             "Processor may be stalled.  Now at tick - %ld, last op at %ld\n",
             tickCount, tickCount - STALL_TIME);
         for (int i = 0; i < processorCount; i++)
         {
-            if (pendingMem[i] == 1)
+            if (pendingMem[i] > 0)
             {
                 printf("Processor %d is waiting on memory\n", i);
             }
@@ -129,10 +161,11 @@ int tick(void)
     int progress = 0;
     for (int i = 0; i < processorCount; i++)
     {
-        if (pendingMem[i] == 1)
+        if (pendingMem[i] > 0)
         {
             progress = 1;
-            continue;
+            if (pendingMem[i] >= maxMemOps)
+                continue;
         }
 
         // In the full processor simulator, the branch is pending until
@@ -156,14 +189,16 @@ int tick(void)
         {
             case MEM_LOAD:
             case MEM_STORE:
-                pendingMem[i] = 1;
-                cs->memoryRequest(nextOp, i, makeTag(i, memOpTag[i]),
+                pendingMem[i]++;
+                issueMemOp(i);
+                cs->memoryRequest(nextOp, i, makeTag(i, memOpTag[i]++),
                                   memOpCallback);
                 break;
 
             case BRANCH:
                 pendingBranch[i]
-                    = (bs->branchRequest(nextOp, i) == nextOp->nextPCAddress)
+                    = (bs->branchRequest(nextOp, i) == nextOp->nextPCAddress
+                       || CADSS_FUNCTIONAL)
                           ? 0
                           : 1;
                 break;
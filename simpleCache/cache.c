@@ -2,7 +2,9 @@
 #include <trace.h>
 
 #include <getopt.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include <coherence.h>
@@ -12,17 +14,33 @@ cache* self = NULL;
 
 int processorCount = 1;
 int CADSS_VERBOSE = 0;
+int CADSS_FUNCTIONAL = 0;
 int blockSize = 1;
 
-coher* coherComp = NULL;
-
-int64_t* pendingTag = NULL;
+//
+// Each processor's cache holds 2^s sets of E lines, with LRU replacement.  A
+//   line is allocated when it is requested, and the line it replaces is given
+//   back to the coherence component with invlReq, so only lines that fit in
+//   the caches keep coherence state.  Without -E and -s the caches never fill.
+//
+int linesPerSet = 0;
+int setBits = 0;
+
+typedef struct _cacheLine {
+    uint64_t addr;
+    uint64_t used; // last use, 0 if the way is empty
+} cacheLine;
+
+// Every processor's cache in one array, processor by processor
+cacheLine* lines = NULL;
+uint64_t useCount = 0;
+uint64_t evictions = 0;
+uint64_t writebacks = 0;
 
-typedef void (*memCallbackFunc)(int, int64_t);
-
-memCallbackFunc* memCallback = NULL;
+coher* coherComp = NULL;
 
 void coherCallback(int type, int processorNum, int64_t addr);
+static void pendInit(void);
 void memoryRequest(trace_op* op, int processorNum, int64_t tag,
                    void (*callback)(int, int64_t));
 
@@ -30,19 +48,18 @@ cache* init(cache_sim_args* csa)
 {
     int op;
 
-    // TODO - get argument list from assignment
     while ((op = getopt(csa->arg_count, csa->arg_list, "E:s:b:i:R:")) != -1)
     {
         switch (op)
         {
             // Lines per set
             case 'E':
-
+                linesPerSet = atoi(optarg);
                 break;
 
             // Sets per cache
             case 's':
-
+                setBits = atoi(optarg);
                 break;
 
             // block size in bits
@@ -71,71 +88,239 @@ cache* init(cache_sim_args* csa)
     coherComp = csa->coherComp;
     coherComp->registerCacheInterface(coherCallback);
 
-    memCallback = calloc(processorCount, sizeof(memCallbackFunc));
-    pendingTag = calloc(processorCount, sizeof(int));
+    pendInit();
+
+    if (linesPerSet > 0)
+    {
+        size_t perCache = (size_t)linesPerSet << setBits;
+        lines = calloc(perCache * processorCount, sizeof(cacheLine));
+    }
 
     return self;
 }
 
+// Returns the first way of addr's set in processorNum's cache
+static cacheLine* setOf(uint64_t addr, int processorNum)
+{
+    uint64_t set = (addr / blockSize) & ((1UL << setBits) - 1);
+    size_t cacheStart = ((size_t)processorNum << setBits) * linesPerSet;
+    return &lines[cacheStart + set * linesPerSet];
+}
+
+// Makes addr the most recently used line, replacing the LRU line if it is
+//   not cached yet
+static void touchLine(uint64_t addr, int processorNum)
+{
+    cacheLine* set = setOf(addr, processorNum);
+    int victim = 0;
+
+    for (int w = 0; w < linesPerSet; w++)
+    {
+        if (set[w].used != 0 && set[w].addr == addr)
+        {
+            set[w].used = ++useCount;
+            return;
+        }
+        if (set[w].used < set[victim].used)
+            victim = w;
+    }
+
+    if (set[victim].used != 0)
+    {
+        uint8_t flushed = coherComp->invlReq(set[victim].addr, processorNum);
+        if (!CADSS_FUNCTIONAL)
+        {
+            evictions++;
+            writebacks += flushed;
+        }
+    }
+    set[victim].addr = addr;
+    set[victim].used = ++useCount;
+}
+
+// The coherence component took addr away from processorNum
+static void dropLine(uint64_t addr, int processorNum)
+{
+    cacheLine* set = setOf(addr, processorNum);
+    for (int w = 0; w < linesPerSet; w++)
+    {
+        if (set[w].used != 0 && set[w].addr == addr)
+        {
+            set[w].used = 0;
+            return;
+        }
+    }
+}
+
 typedef struct _pendingRequest {
     int64_t tag;
     int64_t addr;
     int processorNum;
+    uint8_t isRead;
     void (*callback)(int, int64_t);
-    struct _pendingRequest* next;
+    struct _pendingRequest* next; // a list below, a pending chain or free list
 } pendingRequest;
 
 pendingRequest* readyReq = NULL;
-pendingRequest* pendReq = NULL;
+
+// A request made while its line was in a transition did not get permission
+//   and did not start one either.  When the transition is done it asks again.
+pendingRequest* retryReq = NULL;
+
+static void askPermission(pendingRequest* pr);
+
+//
+// Requests waiting on the coherence component are hashed by (processor,
+//   address) into chains, newest first, so DATA_RECV finds its request
+//   without walking every outstanding one.  The table doubles when it holds
+//   more requests than chains.
+//
+pendingRequest** pendTable = NULL;
+int pendBits = 0;
+int pendCount = 0;
+
+//
+// Request nodes come from slabs and go back to a free list, rather than a
+//   malloc and free for every access.
+//
+#define SLAB_REQUESTS 256
+
+typedef struct _requestSlab {
+    struct _requestSlab* next;
+    pendingRequest reqs[SLAB_REQUESTS];
+} requestSlab;
+
+requestSlab* slabs = NULL;
+pendingRequest* freeReq = NULL;
+
+static pendingRequest* allocRequest(void)
+{
+    if (freeReq == NULL)
+    {
+        requestSlab* slab = malloc(sizeof(requestSlab));
+        slab->next = slabs;
+        slabs = slab;
+        for (int i = 0; i < SLAB_REQUESTS; i++)
+        {
+            slab->reqs[i].next = freeReq;
+            freeReq = &slab->reqs[i];
+        }
+    }
+
+    pendingRequest* pr = freeReq;
+    freeReq = pr->next;
+    return pr;
+}
+
+static void freeRequest(pendingRequest* pr)
+{
+    pr->next = freeReq;
+    freeReq = pr;
+}
+
+static void pendInit(void)
+{
+    pendBits = 6;
+    pendTable = calloc(1 << pendBits, sizeof(pendingRequest*));
+}
+
+static pendingRequest** pendChain(int processorNum, int64_t addr)
+{
+    uint64_t key = (uint64_t)addr ^ ((uint64_t)processorNum << 48);
+    return &pendTable[(key * 0x9E3779B97F4A7C15UL) >> (64 - pendBits)];
+}
+
+static void pendInsert(pendingRequest* pr)
+{
+    pendingRequest** chain = pendChain(pr->processorNum, pr->addr);
+    pr->next = *chain;
+    *chain = pr;
+    pendCount++;
+}
+
+static void pendGrow(void)
+{
+    pendingRequest** old = pendTable;
+    int oldSize = 1 << pendBits;
+
+    pendBits++;
+    pendTable = calloc(1 << pendBits, sizeof(pendingRequest*));
+    pendCount = 0;
+    for (int i = 0; i < oldSize; i++)
+    {
+        // Reverse the chain first, so that newer requests stay in front
+        pendingRequest* rev = NULL;
+        while (old[i] != NULL)
+        {
+            pendingRequest* pr = old[i];
+            old[i] = pr->next;
+            pr->next = rev;
+            rev = pr;
+        }
+        while (rev != NULL)
+        {
+            pendingRequest* pr = rev;
+            rev = rev->next;
+            pendInsert(pr);
+        }
+    }
+    free(old);
+}
 
 // type could be READ, WRITE, INVALIDATE, simple ignores this
 void coherCallback(int type, int processorNum, int64_t addr)
 {
-    assert(pendReq != NULL);
     assert(processorNum < processorCount);
 
-    // "simpleCache" does not support invalidations.
+    if (type == INVALIDATE && linesPerSet > 0)
+    {
+        dropLine(addr, processorNum);
+        return;
+    }
     if (type != DATA_RECV)
         return;
 
-    if (pendReq->processorNum == processorNum && pendReq->addr == addr)
-    {
-        pendingRequest* pr = pendReq;
-        pendReq = pendReq->next;
+    assert(pendCount > 0);
 
-        pr->next = readyReq;
-        readyReq = pr; \
-    }
-    else
+    // The oldest request for the line is the one that started the transition,
+    // the others retry
+    pendingRequest** prev = pendChain(processorNum, addr);
+    pendingRequest* oldest = NULL;
+    for (pendingRequest* pr = *prev; pr != NULL; pr = *prev)
     {
-        pendingRequest* prevReq = pendReq;
-        pendingRequest* pr = pendReq->next;
-
-        while (pr != NULL)
+        if (pr->processorNum != processorNum || pr->addr != addr)
         {
-            if (pr->processorNum == processorNum && pr->addr == addr)
-            {
-                prevReq->next = pr->next;
+            prev = &pr->next;
+            continue;
+        }
 
-                pr->next = readyReq;
-                readyReq = pr;
-                break;
-            }
-            pr = pr->next;
-            prevReq = prevReq->next;
+        *prev = pr->next;
+        pendCount--;
+        if (oldest != NULL)
+        {
+            oldest->next = retryReq;
+            retryReq = oldest;
         }
+        oldest = pr;
+    }
+    if (oldest != NULL)
+    {
+        oldest->next = readyReq;
+        readyReq = oldest;
+        return;
+    }
 
-        if (pr == NULL && CADSS_VERBOSE == 1)
+    if (CADSS_VERBOSE == 1)
+    {
+        for (int i = 0; i < (1 << pendBits); i++)
         {
-            pr = pendReq;
-            while (pr != NULL)
+            for (pendingRequest* pr = pendTable[i]; pr != NULL; pr = pr->next)
             {
                 printf("W: %p (%lx %d)\t", pr, pr->addr, pr->processorNum);
-                pr = pr->next;
             }
         }
-        assert(pr != NULL);
     }
+    assert(0);
 }
 
 void memoryRequest(trace_op* op, int processorNum, int64_t tag,
@@ -146,16 +331,35 @@ void memoryRequest(trace_op* op, int processorNum, int64_t tag,
 
     // As a simplifying assumption, requests do not cross cache lines
     uint64_t addr = (op->memAddress & ~(blockSize - 1));
-    uint8_t perm
-        = coherComp->permReq((op->op == MEM_LOAD), addr, processorNum);
+    if (linesPerSet > 0)
+        touchLine(addr, processorNum);
+    coherComp->noteAccess((op->op == MEM_LOAD), op->memAddress, op->size,
+                          blockSize, processorNum);
+
+    // Functional warmup resolves the permissions immediately
+    if (CADSS_FUNCTIONAL)
+    {
+        uint8_t perm
+            = coherComp->permReq((op->op == MEM_LOAD), addr, processorNum);
+        assert(perm == 1);
+        callback(processorNum, tag);
+        return;
+    }
 
-    pendingRequest* pr = malloc(sizeof(pendingRequest));
+    pendingRequest* pr = allocRequest();
     pr->tag = tag;
     pr->addr = addr;
     pr->callback = callback;
     pr->processorNum = processorNum;
+    pr->isRead = (op->op == MEM_LOAD);
+    askPermission(pr);
+}
 
-    if (perm == 1)
+// pr is answered next tick if it has permission, otherwise it waits for the
+//   coherence component
+static void askPermission(pendingRequest* pr)
+{
+    if (coherComp->permReq(pr->isRead, pr->addr, pr->processorNum) == 1)
     {
         // create callback for next tick
         pr->next = readyReq;
@@ -164,8 +368,9 @@ void memoryRequest(trace_op* op, int processorNum, int64_t tag,
     else
     {
         // create pending callback
-        pr->next = pendReq;
-        pendReq = pr;
+        if (pendCount >= (1 << pendBits))
+            pendGrow();
+        pendInsert(pr);
     }
 }
 
@@ -174,25 +379,53 @@ int tick()
     coherComp->si.tick();
 
     pendingRequest* pr = readyReq;
+    readyReq = NULL;
     while (pr != NULL)
     {
         pendingRequest* t = pr;
         pr->callback(pr->processorNum, pr->tag);
         pr = pr->next;
-        free(t);
+        freeRequest(t);
+    }
+
+    // A line evicted while its request waited is brought back in
+    pr = retryReq;
+    retryReq = NULL;
+    while (pr != NULL)
+    {
+        pendingRequest* next = pr->next;
+        if (linesPerSet > 0)
+            touchLine(pr->addr, pr->processorNum);
+        askPermission(pr);
+        pr = next;
     }
-    readyReq = NULL;
 
     return 1;
 }
 
 int finish(int outFd)
 {
-    return 0;
+    if (linesPerSet > 0)
+    {
+        char buf[96];
+        int n = snprintf(buf, sizeof(buf), "evictions:%lu writebacks:%lu\n",
+                         evictions, writebacks);
+        (void)!write(outFd, buf, n);
+    }
+    return coherComp->si.finish(outFd);
 }
 
 int destroy(void)
 {
     // free any internally allocated memory here
+    while (slabs != NULL)
+    {
+        requestSlab* slab = slabs;
+        slabs = slab->next;
+        free(slab);
+    }
+    free(pendTable);
+    free(lines);
+    free(self);
     return 0;
 }
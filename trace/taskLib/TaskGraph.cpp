@@ -199,3 +199,12 @@ TaskId TaskGraph::getROIEnd()
 {
     return ROIEnd;
 }
+
+uint64 TaskGraph::getTaskPosition(TaskId tid)
+{
+    auto it = taskIdx.find(tid);
+    
+    if (it == taskIdx.end()) return UINT64_MAX;
+    
+    return it->second;
+}
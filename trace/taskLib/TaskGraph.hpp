@@ -68,6 +68,10 @@ public:
     TaskId getROIStart();
     TaskId getROIEnd();
     
+    // Tasks are written to the file in a valid execution order, so the
+    //   file position orders any two tasks (UINT64_MAX if not in the graph)
+    uint64 getTaskPosition(TaskId tid);
+    
     TaskGraphInfo* getTaskGraphInfo();
     ~TaskGraph();
 };
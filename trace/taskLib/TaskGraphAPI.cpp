@@ -8,8 +8,16 @@ contech::TaskGraph* tg = NULL;
 
 int contextCount = 1;
 
+// Region of interest, as positions in the task graph's file order
+bool roiOnly = false;
+bool roiWarmup = false;
+int roiContexts = 0;
+uint64_t roiStartPos = 0;
+uint64_t roiEndPos = UINT64_MAX;
+
 struct taskTrack {
   bool isComplete;
+  bool inROI;
   contech::TaskId tid;
   contech::Task* t;  
   contech::Task::memOpCollection moc;
@@ -49,6 +57,54 @@ int8_t initTaskGraph(FILE* tf)
     return 1;
 }
 
+//
+// initTaskGraphROI
+//
+//   Restrict the simulation to the region of interest.  Until every active
+// context has reached ROIStart, ops are for functional warmup and contexts
+// that already reached it are held.  Tasks after ROIEnd are not returned.
+//
+int8_t initTaskGraphROI(int activeContexts)
+{
+    if (tg == NULL) return -1;
+    
+    contech::TaskId roiStart = tg->getROIStart();
+    contech::TaskId roiEnd = tg->getROIEnd();
+    
+    roiStartPos = tg->getTaskPosition(roiStart);
+    if (roiStartPos == UINT64_MAX)
+    {
+        fprintf(stderr, "ROIStart %s is not in the task graph\n", roiStart.toString().c_str());
+        return -1;
+    }
+    
+    // An unset ROIEnd leaves the region open until the end of the graph
+    if (roiEnd != contech::TaskId(0))
+    {
+        roiEndPos = tg->getTaskPosition(roiEnd);
+    }
+    
+    roiContexts = (activeContexts < contextCount) ? activeContexts : contextCount;
+    roiOnly = true;
+    roiWarmup = true;
+    
+    return 1;
+}
+
+int8_t inTaskGraphWarmup(void)
+{
+    if (roiWarmup == false) return 0;
+    
+    for (int i = 0; i < roiContexts; i++)
+    {
+        if (currentTasks[i].isComplete == false && 
+            currentTasks[i].inROI == false) return 1;
+    }
+    
+    roiWarmup = false;
+    return 0;
+}
+
 void updateContext(int processorNum)
 {
     if (currentTasks[processorNum].isComplete == true) return;
@@ -64,6 +120,19 @@ void updateContext(int processorNum)
         return;
     }
     
+    if (roiOnly == true)
+    {
+        uint64_t pos = tg->getTaskPosition(currentTasks[processorNum].tid);
+        if (pos > roiEndPos)
+        {
+            delete t;
+            currentTasks[processorNum].t = NULL;
+            currentTasks[processorNum].isComplete = true;
+            return;
+        }
+        currentTasks[processorNum].inROI = (pos >= roiStartPos);
+    }
+    
     if (t->getType() != contech::task_type_basic_blocks)
     {
         currentTasks[processorNum].tid = currentTasks[processorNum].tid.getNext();
@@ -102,7 +171,7 @@ trace_op* getNextOp(int processorNum)
      
         if (t == NULL) return NULL;
      
-        if (currentTasks[processorNum].mit == currentTasks[processorNum].met)
+        while (currentTasks[processorNum].mit == currentTasks[processorNum].met)
         {
             currentTasks[processorNum].tid = currentTasks[processorNum].tid.getNext();
             updateContext(processorNum);
@@ -110,6 +179,9 @@ trace_op* getNextOp(int processorNum)
             if (currentTasks[processorNum].t == NULL) return NULL;
         }
         
+        // Contexts in the ROI wait for the rest to finish warming up
+        if (roiWarmup == true && currentTasks[processorNum].inROI == true) return NULL;
+        
         contech::MemoryAction ma = *currentTasks[processorNum].mit;
         currentTasks[processorNum].mit++;
         
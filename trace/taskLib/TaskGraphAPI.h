@@ -9,6 +9,8 @@ extern "C" {
 #include <trace.h>
 
 int8_t initTaskGraph(FILE*);
+int8_t initTaskGraphROI(int activeContexts);
+int8_t inTaskGraphWarmup(void);
 trace_op* getNextOp(int processorNum);
 
 #ifdef __cplusplus
@@ -15,6 +15,7 @@
 #include <dlfcn.h>
 
 trace_op* getNextOp(int);
+int inWarmup(void);
 
 int processorCount = 1;
 
@@ -22,7 +23,10 @@ FILE** traceFile = NULL;
 int masterFD = 0;
 
 int8_t isTaskGraph = 0;
+int8_t roiOnly = 0;
+uint64_t warmupOps = 0;
 trace_op* (*gno)(int processorNum) = NULL;
+int8_t (*itgw)(void) = NULL;
 
 trace_reader* init(trace_sim_args* tsa)
 {
@@ -30,15 +34,22 @@ trace_reader* init(trace_sim_args* tsa)
     trace_reader* tr = malloc(sizeof(trace_reader));
     if (tr == NULL) return NULL;
     tr->getNextOp = getNextOp;
+    tr->inWarmup = inWarmup;
     
     int op = 0;
-    while ((op = getopt(tsa->arg_count, tsa->arg_list, "hdvc:p:o:n:i:b:t:s:m:")) != -1)
+    while ((op = getopt(tsa->arg_count, tsa->arg_list, "hdvrc:p:o:n:i:b:t:s:m:w:")) != -1)
     {
         switch (op)
         {
             case 't':
                 trace = optarg;
                 break;
+            case 'r':
+                roiOnly = 1;
+                break;
+            case 'w':
+                warmupOps = strtoull(optarg, NULL, 10);
+                break;
         }
     }
     
@@ -82,12 +93,27 @@ trace_reader* init(trace_sim_args* tsa)
                 }
                 
                 gno = dlsym(handle, "getNextOp");
+                
+                if (roiOnly == 1)
+                {
+                    int8_t (*itgr)(int) = dlsym(handle, "initTaskGraphROI");
+                    itgw = dlsym(handle, "inTaskGraphWarmup");
+                    if (itgr == NULL || itgw == NULL || itgr(processorCount) != 1)
+                    {
+                        itgw = NULL;
+                    }
+                }
             }
         }
         
         // openat()
     }
     
+    if (roiOnly == 1 && itgw == NULL)
+    {
+        fprintf(stderr, "Region of interest is only available for taskgraphs, simulating the whole trace\n");
+    }
+    
     tr->si.tick = tick;
     tr->si.finish = finish;
     tr->si.destroy = destroy;
@@ -103,7 +129,10 @@ trace_op* getNextOp(int processorNum)
     
     if (isTaskGraph == 1)
     {
-        return gno(processorNum);
+        free(op);
+        op = gno(processorNum);
+        if (op != NULL) opCount++;
+        return op;
     }
     
     if (traceFile[processorNum] == NULL)
@@ -226,6 +255,20 @@ trace_op* getNextOp(int processorNum)
     return op;
 }
 
+//
+// inWarmup
+//
+//   Are the ops being returned still before the region of interest, or
+//   among the first -w ops?
+//
+int inWarmup(void)
+{
+    if (opCount < warmupOps) return 1;
+    if (itgw == NULL) return 0;
+    
+    return itgw();
+}
+
 int tick(void)
 {
     return 1;    